@@ -0,0 +1,259 @@
+#include "aes.h"
+#include "cache.h"
+#include "ndma.h"
+#include "timer.h"
+
+#define AES_KEYSLOTS 0x40u
+#define AES_NO_KEYSLOT 0xFFu
+
+// What was last written to each keyslot, so setting the same key again can
+// be skipped. The hardware can't be read back.
+static struct {
+    u32 key[3][4];
+    u8 valid; // Bit per key type
+} keyslots[AES_KEYSLOTS];
+
+static u32 selected_keyslot = AES_NO_KEYSLOT;
+
+static void AES_SetKeyControl(u32 a) {
+    REG_AESKEYCNT = (REG_AESKEYCNT & 0xC0) | a | 0x80;
+}
+
+void aes_init(void) {
+    memset(keyslots, 0, sizeof(keyslots));
+    selected_keyslot = AES_NO_KEYSLOT;
+    ndma_init();
+}
+
+void aes_setkey(u32 keyslot, const void* key, u32 type) {
+    static vu32* const fifos[3] = { &REG_AESKEYFIFO, &REG_AESKEYXFIFO, &REG_AESKEYYFIFO };
+    u32 words[4];
+
+    if (keyslot < 4 || keyslot >= AES_KEYSLOTS || type > AES_KEY_Y)
+        return;
+    memcpy(words, key, sizeof(words));
+    if ((keyslots[keyslot].valid & (1u << type)) &&
+        !memcmp(keyslots[keyslot].key[type], words, sizeof(words)))
+        return;
+
+    REG_AESCNT = AES_INPUT_BIG_ENDIAN | AES_INPUT_NORMAL_ORDER;
+    AES_SetKeyControl(keyslot);
+    for (u32 i = 0; i < 4; ++i)
+        *fifos[type] = words[i];
+
+    memcpy(keyslots[keyslot].key[type], words, sizeof(words));
+    keyslots[keyslot].valid |= 1u << type;
+    // The normal key is generated when Y is written, a new X needs Y again
+    if (type == AES_KEY_X)
+        keyslots[keyslot].valid &= ~(1u << AES_KEY_Y);
+    if (keyslot == selected_keyslot)
+        selected_keyslot = AES_NO_KEYSLOT;
+}
+
+void aes_use_keyslot(u32 keyslot) {
+    if (keyslot >= AES_KEYSLOTS || keyslot == selected_keyslot)
+        return;
+    REG_AESKEYSEL = keyslot;
+    REG_AESCNT = REG_AESCNT | AES_UPDATE_KEYSLOT;
+    selected_keyslot = keyslot;
+}
+
+void aes_ctr_add(void* ctr, u32 blocks) {
+    u8* c = ctr;
+    u32 carry = blocks;
+
+    for (int i = AES_BLOCK_SIZE - 1; i >= 0 && carry; --i) {
+        carry += c[i];
+        c[i] = carry & 0xFF;
+        carry >>= 8;
+    }
+}
+
+// The CTR and MAC registers take their words last first
+static void aes_set_reg(vu32* reg, const void* data, u32 words) {
+    u32 tmp[4];
+
+    memcpy(tmp, data, words * 4);
+    REG_AESCNT = AES_INPUT_BIG_ENDIAN | AES_INPUT_NORMAL_ORDER;
+    for (u32 i = 0; i < words; ++i)
+        reg[i] = tmp[words - 1 - i];
+}
+
+static u32 aes_data_cnt(u32 mode) {
+    return AES_MODE(mode) | AES_INPUT_BIG_ENDIAN | AES_INPUT_NORMAL_ORDER |
+        AES_OUTPUT_BIG_ENDIAN | AES_OUTPUT_NORMAL_ORDER;
+}
+
+static void aes_start(u32 blocks, u32 cnt) {
+    REG_AESBLKCNT = blocks << 16;
+    REG_AESCNT = cnt | AES_ENABLE | AES_FLUSH_READ_FIFO | AES_FLUSH_WRITE_FIFO |
+        AES_WRFIFO_DMA_SIZE(4) | AES_RDFIFO_DMA_SIZE(4);
+}
+
+// Keeps the write FIFO as full as it goes and empties the read FIFO as
+// blocks come out, so the engine never waits on the CPU for long.
+static int aes_run_fifo(u8* out, const u8* in, u32 blocks) {
+    struct Timeout timeout;
+    u32 blocks_in = 0, blocks_out = 0;
+    u32 words[4];
+
+    timeout_start(&timeout, AES_TIMEOUT_MS);
+    while (blocks_out < blocks) {
+        bool progress = false;
+
+        while (blocks_in < blocks && AES_WRITE_FIFO_COUNT <= 12) {
+            memcpy(words, in, AES_BLOCK_SIZE);
+            REG_AESWRFIFO = words[0];
+            REG_AESWRFIFO = words[1];
+            REG_AESWRFIFO = words[2];
+            REG_AESWRFIFO = words[3];
+            in += AES_BLOCK_SIZE;
+            ++blocks_in;
+            progress = true;
+        }
+        while (blocks_out < blocks && AES_READ_FIFO_COUNT >= 4) {
+            words[0] = REG_AESRDFIFO;
+            words[1] = REG_AESRDFIFO;
+            words[2] = REG_AESRDFIFO;
+            words[3] = REG_AESRDFIFO;
+            memcpy(out, words, AES_BLOCK_SIZE);
+            out += AES_BLOCK_SIZE;
+            ++blocks_out;
+            progress = true;
+        }
+
+        if (progress)
+            timeout_start(&timeout, AES_TIMEOUT_MS);
+        else if (timeout_expired(&timeout))
+            return AES_ERR_TIMEOUT;
+    }
+    return AES_OK;
+}
+
+// One NDMA channel fills the write FIFO and the other empties the read
+// FIFO, a block at a time as the engine asks for it.
+static int aes_run_dma(u8* out, const u8* in, u32 blocks) {
+    const u32 size = blocks * AES_BLOCK_SIZE;
+    struct Timeout timeout;
+
+    cache_flush_range(in, size);
+    cache_flush_range(out, size);
+
+    REG_NDMA_SAD(NDMA_CHANNEL_AES_OUT) = (u32)&REG_AESRDFIFO;
+    REG_NDMA_DAD(NDMA_CHANNEL_AES_OUT) = (u32)out;
+    REG_NDMA_TCNT(NDMA_CHANNEL_AES_OUT) = size / 4;
+    REG_NDMA_WCNT(NDMA_CHANNEL_AES_OUT) = 4;
+    REG_NDMA_BCNT(NDMA_CHANNEL_AES_OUT) = 0;
+    REG_NDMA_CNT(NDMA_CHANNEL_AES_OUT) = NDMA_ENABLE | NDMA_STARTUP(NDMA_STARTUP_AES_OUT) |
+        NDMA_BURST_WORDS(2) | NDMA_SRC_FIXED | NDMA_DST_INCREMENT;
+
+    REG_NDMA_SAD(NDMA_CHANNEL_AES_IN) = (u32)in;
+    REG_NDMA_DAD(NDMA_CHANNEL_AES_IN) = (u32)&REG_AESWRFIFO;
+    REG_NDMA_TCNT(NDMA_CHANNEL_AES_IN) = size / 4;
+    REG_NDMA_WCNT(NDMA_CHANNEL_AES_IN) = 4;
+    REG_NDMA_BCNT(NDMA_CHANNEL_AES_IN) = 0;
+    REG_NDMA_CNT(NDMA_CHANNEL_AES_IN) = NDMA_ENABLE | NDMA_STARTUP(NDMA_STARTUP_AES_IN) |
+        NDMA_BURST_WORDS(2) | NDMA_SRC_INCREMENT | NDMA_DST_FIXED;
+
+    // Allow for at least 16MB/s
+    timeout_start(&timeout, AES_TIMEOUT_MS + (size >> 14));
+    while (ndma_busy(NDMA_CHANNEL_AES_OUT)) {
+        if (timeout_expired(&timeout)) {
+            ndma_stop(NDMA_CHANNEL_AES_IN);
+            ndma_stop(NDMA_CHANNEL_AES_OUT);
+            return AES_ERR_TIMEOUT;
+        }
+    }
+    return AES_OK;
+}
+
+static int aes_run(void* out, const void* in, u32 blocks, u32 cnt) {
+    struct Timeout timeout;
+    int res;
+
+    aes_start(blocks, cnt);
+    if (blocks >= AES_DMA_MIN_BLOCKS && !(((u32)in | (u32)out) & 3))
+        res = aes_run_dma(out, in, blocks);
+    else
+        res = aes_run_fifo(out, in, blocks);
+
+    // CCM still checks the MAC after the last block is out
+    timeout_start(&timeout, AES_TIMEOUT_MS);
+    while (res == AES_OK && (REG_AESCNT & AES_ENABLE)) {
+        if (timeout_expired(&timeout))
+            res = AES_ERR_TIMEOUT;
+    }
+    if (res != AES_OK)
+        REG_AESCNT = 0;
+    return res;
+}
+
+int aes_ctr(void* out, const void* in, u32 blocks, void* ctr) {
+    u8* dst = out;
+    const u8* src = in;
+
+    while (blocks) {
+        const u32 count = blocks < AES_MAX_BLOCKS ? blocks : AES_MAX_BLOCKS;
+
+        aes_set_reg(REG_AESCTR, ctr, 4);
+        int res = aes_run(dst, src, count, aes_data_cnt(AES_MODE_CTR));
+        if (res != AES_OK)
+            return res;
+
+        aes_ctr_add(ctr, count);
+        dst += count * AES_BLOCK_SIZE;
+        src += count * AES_BLOCK_SIZE;
+        blocks -= count;
+    }
+    return AES_OK;
+}
+
+static int aes_cbc(void* out, const void* in, u32 blocks, void* iv, u32 mode) {
+    u8* dst = out;
+    const u8* src = in;
+    u8 next_iv[AES_BLOCK_SIZE];
+
+    while (blocks) {
+        const u32 count = blocks < AES_MAX_BLOCKS ? blocks : AES_MAX_BLOCKS;
+        const u32 last = (count - 1) * AES_BLOCK_SIZE;
+
+        // The IV for what follows is the last ciphertext block, which is
+        // overwritten when decrypting in place
+        if (mode == AES_MODE_CBC_DECRYPT)
+            memcpy(next_iv, src + last, AES_BLOCK_SIZE);
+
+        aes_set_reg(REG_AESCTR, iv, 4);
+        int res = aes_run(dst, src, count, aes_data_cnt(mode));
+        if (res != AES_OK)
+            return res;
+
+        if (mode == AES_MODE_CBC_ENCRYPT)
+            memcpy(next_iv, dst + last, AES_BLOCK_SIZE);
+        memcpy(iv, next_iv, AES_BLOCK_SIZE);
+        dst += count * AES_BLOCK_SIZE;
+        src += count * AES_BLOCK_SIZE;
+        blocks -= count;
+    }
+    return AES_OK;
+}
+
+int aes_cbc_decrypt(void* out, const void* in, u32 blocks, void* iv) {
+    return aes_cbc(out, in, blocks, iv, AES_MODE_CBC_DECRYPT);
+}
+
+int aes_cbc_encrypt(void* out, const void* in, u32 blocks, void* iv) {
+    return aes_cbc(out, in, blocks, iv, AES_MODE_CBC_ENCRYPT);
+}
+
+int aes_ccm_decrypt(void* out, const void* in, u32 blocks, const void* nonce, const void* mac) {
+    if (blocks > AES_MAX_BLOCKS)
+        return 0;
+
+    aes_set_reg(REG_AESMAC, mac, 4);
+    aes_set_reg(REG_AESCTR, nonce, 3);
+    int res = aes_run(out, in, blocks, aes_data_cnt(AES_MODE_CCM_DECRYPT) |
+        AES_MAC_SIZE(7) | AES_MAC_REGISTER_SOURCE);
+    if (res != AES_OK)
+        return res;
+    return (REG_AESCNT >> 21) & 1;
+}
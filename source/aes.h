@@ -30,8 +30,8 @@
 
 #define AES_FLUSH_READ_FIFO     (1u<<10)
 #define AES_FLUSH_WRITE_FIFO    (1u<<11)
-#define AES_BIT12               (1u<<12)
-#define AES_BIT13               (1u<<13)
+#define AES_WRFIFO_DMA_SIZE(w)  ((((w)/4u-1u)&3u)<<12) // In words: 4, 8, 12 or 16
+#define AES_RDFIFO_DMA_SIZE(w)  ((((w)/4u-1u)&3u)<<14)
 #define AES_MAC_SIZE(n)         ((n&7u)<<16)
 #define AES_MAC_REGISTER_SOURCE (1u<<20)
 #define AES_UNKNOWN_21          (1u<<21)
@@ -39,7 +39,7 @@
 #define AES_INPUT_BIG_ENDIAN    (1u<<23)
 #define AES_OUTPUT_NORMAL_ORDER (1u<<24)
 #define AES_INPUT_NORMAL_ORDER  (1u<<25)
-#define AES_UNKNOWN_26          (1u<<26)
+#define AES_UPDATE_KEYSLOT      (1u<<26)
 #define AES_MODE(n)             ((n&7u)<<27)
 #define AES_INTERRUPT_ENABLE    (1u<<30)
 #define AES_ENABLE              (1u<<31)
@@ -52,3 +52,48 @@
 #define AES_MODE_CBC_ENCRYPT    5u
 #define AES_MODE_UNK6           6u
 #define AES_MODE_UNK7           7u
+
+#define AES_BLOCK_SIZE          16u
+
+// Blocks in one run of the engine, the upper half of REG_AESBLKCNT
+#define AES_MAX_BLOCKS          0xFFFFu
+
+// Transfers from this size on are fed to the engine by NDMA, shorter ones
+// by the CPU
+#define AES_DMA_MIN_BLOCKS      32u
+
+// No progress for this long means the engine hung
+#define AES_TIMEOUT_MS          100u
+
+#define AES_OK                  0
+#define AES_ERR_TIMEOUT         -3
+
+#define AES_KEY_NORMAL          0u
+#define AES_KEY_X               1u
+#define AES_KEY_Y               2u
+
+#define AES_KEYSLOT_CART_DEV    0x11u
+#define AES_KEYSLOT_CART        0x3Bu
+
+// Keys, counters and IVs are 16 bytes in the byte order they are stored
+// in, counters count big endian as in NCCH. Only keyslots 0x04-0x3F are
+// supported.
+
+void aes_init(void);
+
+// Setting a key the slot already holds does nothing, so this is cheap to
+// call for every block of data.
+void aes_setkey(u32 keyslot, const void* key, u32 type);
+void aes_use_keyslot(u32 keyslot);
+
+void aes_ctr_add(void* ctr, u32 blocks);
+
+// Data may be processed in place. The counter or IV is advanced to follow
+// on from the processed data. Return AES_OK or AES_ERR_TIMEOUT.
+int aes_ctr(void* out, const void* in, u32 blocks, void* ctr);
+int aes_cbc_decrypt(void* out, const void* in, u32 blocks, void* iv);
+int aes_cbc_encrypt(void* out, const void* in, u32 blocks, void* iv);
+
+// CCM decrypt with a 12 byte nonce and 16 byte MAC. Returns 1 if the MAC
+// matched, 0 if not, or AES_ERR_TIMEOUT.
+int aes_ccm_decrypt(void* out, const void* in, u32 blocks, const void* nonce, const void* mac);
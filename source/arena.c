@@ -0,0 +1,28 @@
+#include "arena.h"
+
+static size_t arena_used = 0;
+
+// Returns NULL if the arena can't fit the block. Memory is not cleared.
+void* arena_alloc(size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (size > arena_available())
+        return NULL;
+
+    void* ptr = (void*)(ARENA_START + arena_used);
+    arena_used += size;
+    return ptr;
+}
+
+// Everything allocated after taking a mark is freed by releasing it.
+size_t arena_mark(void) {
+    return arena_used;
+}
+
+void arena_release(size_t mark) {
+    if (mark < arena_used)
+        arena_used = mark;
+}
+
+size_t arena_available(void) {
+    return (ARENA_END - ARENA_START) - arena_used;
+}
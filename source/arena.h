@@ -0,0 +1,17 @@
+#pragma once
+
+#include "common.h"
+
+// FCRAM between the framebuffers and the payload is handed out as one
+// linear arena for the large working buffers (dump buffer, headers, FatFs
+// tables...).
+#define ARENA_START 0x21000000u
+#define ARENA_END   0x23F00000u
+
+// Allocations are aligned to the 32-byte data cache line.
+#define ARENA_ALIGN 32u
+
+void* arena_alloc(size_t size);
+size_t arena_mark(void);
+void arena_release(size_t mark);
+size_t arena_available(void);
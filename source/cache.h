@@ -0,0 +1,11 @@
+#pragma once
+
+#include "common.h"
+
+// Data cache line size of the ARM946
+#define CACHE_LINE 32u
+
+// Writes back and drops every data cache line overlapping the range, and
+// drains the write buffer. Has to be done on both buffers before DMA
+// touches them; the CPU must leave them alone until the DMA is done.
+void cache_flush_range(const void* addr, size_t size);
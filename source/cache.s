@@ -0,0 +1,20 @@
+.section .text
+.arm
+.align 4
+
+@ void cache_flush_range(const void* addr, size_t size)
+.global cache_flush_range
+.type cache_flush_range, %function
+cache_flush_range:
+    add r1, r0, r1
+    bic r0, r0, #31
+.Lflush_line:
+    cmp r0, r1
+    bhs .Lflush_done
+    mcr p15, 0, r0, c7, c14, 1 @ clean and invalidate D-cache line
+    add r0, r0, #32
+    b .Lflush_line
+.Lflush_done:
+    mov r0, #0
+    mcr p15, 0, r0, c7, c10, 4 @ drain write buffer
+    bx lr
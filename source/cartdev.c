@@ -0,0 +1,173 @@
+#include "cartdev.h"
+#include "arena.h"
+#include "draw.h"
+#include "gamecart/protocol.h"
+#include "gamecart/command_ctr.h"
+#include "gamecart/protocol_ctr.h"
+
+#define NO_BLOCK 0xFFFFFFFFu
+
+struct CacheSlot {
+    u32 block;
+    u32 last_used;
+    bool valid;
+    bool prefetched; // Read ahead and not used yet
+};
+
+static struct CacheSlot* slots;
+static u8* slot_data;
+static u32 slot_count = 0;
+
+// Readahead is read into here in one command, then spread over the slots
+static u8* staging;
+
+static u32 use_clock;
+static u32 cart_blocks;
+static u32 next_sequential; // Block after the last miss
+static u32 readahead;
+
+static struct CartDevStats stats;
+
+bool cartdev_init(u32 cache_blocks, u64 cart_size) {
+    slot_count = 0;
+    if (cache_blocks < 2 * CARTDEV_READAHEAD_MAX)
+        cache_blocks = 2 * CARTDEV_READAHEAD_MAX;
+
+    slots = arena_alloc(cache_blocks * sizeof(struct CacheSlot));
+    slot_data = arena_alloc(cache_blocks * CARTDEV_BLOCK_SIZE);
+    staging = arena_alloc(CARTDEV_READAHEAD_MAX * CARTDEV_BLOCK_SIZE);
+    if (slots == NULL || slot_data == NULL || staging == NULL)
+        return false;
+
+    slot_count = cache_blocks;
+    cart_blocks = (u32)((cart_size + CARTDEV_BLOCK_SIZE - 1) / CARTDEV_BLOCK_SIZE);
+    memset(&stats, 0, sizeof(stats));
+    cartdev_invalidate();
+    return true;
+}
+
+void cartdev_invalidate(void) {
+    for (u32 i = 0; i < slot_count; ++i)
+        slots[i].valid = false;
+    use_clock = 0;
+    next_sequential = NO_BLOCK;
+    readahead = 1;
+}
+
+void cartdev_close(void) {
+    slot_count = 0;
+}
+
+const struct CartDevStats* cartdev_stats(void) {
+    return &stats;
+}
+
+void cartdev_report(void) {
+    Debug("Cart cache: %lu hits, %lu misses", (unsigned long)stats.hits, (unsigned long)stats.misses);
+    Debug("Read ahead %lu blocks, %lu used", (unsigned long)stats.readahead_blocks,
+          (unsigned long)stats.readahead_hits);
+    Debug("%lu cart reads, %lu KB", (unsigned long)stats.cart_reads, (unsigned long)(stats.bytes_read >> 10));
+}
+
+static int cart_read(u32 block, u32 count, u8* dest) {
+    const u32 size = count * CARTDEV_BLOCK_SIZE;
+
+    Cart_Dummy();
+    Cart_Dummy();
+    stats.cart_reads++;
+    stats.bytes_read += size;
+    return CTR_CmdReadData(block * (CARTDEV_BLOCK_SIZE / 0x200), 0x200, size / 0x200, dest);
+}
+
+static struct CacheSlot* find_slot(u32 block) {
+    for (u32 i = 0; i < slot_count; ++i) {
+        if (slots[i].valid && slots[i].block == block)
+            return &slots[i];
+    }
+    return NULL;
+}
+
+static struct CacheSlot* victim_slot(void) {
+    struct CacheSlot* victim = &slots[0];
+
+    for (u32 i = 0; i < slot_count; ++i) {
+        if (!slots[i].valid)
+            return &slots[i];
+        if (slots[i].last_used - victim->last_used > 0x80000000u)
+            victim = &slots[i];
+    }
+    return victim;
+}
+
+static u8* slot_block(const struct CacheSlot* slot) {
+    return slot_data + (u32)(slot - slots) * CARTDEV_BLOCK_SIZE;
+}
+
+static int get_block(u32 block, const u8** data) {
+    struct CacheSlot* slot = find_slot(block);
+
+    if (slot != NULL) {
+        stats.hits++;
+        if (slot->prefetched) {
+            stats.readahead_hits++;
+            slot->prefetched = false;
+        }
+        slot->last_used = ++use_clock;
+        *data = slot_block(slot);
+        return CTRCARD_OK;
+    }
+
+    stats.misses++;
+    // Sequential misses grow the window, anything else starts over
+    if (block == next_sequential)
+        readahead = readahead * 2 > CARTDEV_READAHEAD_MAX ? CARTDEV_READAHEAD_MAX : readahead * 2;
+    else
+        readahead = 1;
+
+    // Don't read past the end of the cart or over what's cached already
+    u32 count = 1;
+    while (count < readahead && block + count < cart_blocks && find_slot(block + count) == NULL)
+        count++;
+
+    int res = cart_read(block, count, staging);
+    if (res != CTRCARD_OK) {
+        readahead = 1;
+        next_sequential = NO_BLOCK;
+        return res;
+    }
+
+    for (u32 i = 0; i < count; ++i) {
+        slot = victim_slot();
+        slot->block = block + i;
+        slot->valid = true;
+        slot->prefetched = i > 0;
+        slot->last_used = ++use_clock;
+        memcpy(slot_block(slot), staging + i * CARTDEV_BLOCK_SIZE, CARTDEV_BLOCK_SIZE);
+        if (i == 0)
+            *data = slot_block(slot);
+    }
+    stats.readahead_blocks += count - 1;
+    next_sequential = block + count;
+    return CTRCARD_OK;
+}
+
+int cartdev_read(u64 offset, u32 size, void* dest) {
+    u8* out = dest;
+
+    while (size > 0) {
+        const u32 block = (u32)(offset / CARTDEV_BLOCK_SIZE);
+        const u32 in_block = (u32)(offset % CARTDEV_BLOCK_SIZE);
+        const u32 length = size < CARTDEV_BLOCK_SIZE - in_block ? size : CARTDEV_BLOCK_SIZE - in_block;
+        const u8* data;
+
+        int res = get_block(block, &data);
+        if (res != CTRCARD_OK)
+            return res;
+        memcpy(out, data + in_block, length);
+
+        out += length;
+        offset += length;
+        size -= length;
+    }
+    return CTRCARD_OK;
+}
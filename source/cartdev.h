@@ -0,0 +1,43 @@
+#pragma once
+
+#include "common.h"
+
+// Random access to cart data, for everything that isn't the linear dump.
+// Reads go through an LRU cache of fixed size blocks held in the arena.
+// Misses that continue where the last one ended are read ahead, the window
+// doubling up to CARTDEV_READAHEAD_MAX blocks while the pattern holds.
+
+#define CARTDEV_BLOCK_SIZE      0x4000u
+#define CARTDEV_READAHEAD_MAX   16u
+
+// Default cache size, 1MiB
+#define CARTDEV_CACHE_BLOCKS    64u
+
+struct CartDevStats {
+    u32 hits;
+    u32 misses;
+    u32 readahead_blocks; // Blocks read before they were asked for
+    u32 readahead_hits;   // ... and later used
+    u32 cart_reads;       // Read commands sent to the cart
+    u64 bytes_read;
+};
+
+// Allocates the cache from the arena, it's gone with it. cart_size in
+// bytes keeps readahead from going past the end. Returns false if the
+// arena is too full.
+bool cartdev_init(u32 cache_blocks, u64 cart_size);
+
+// Drops everything cached, e.g. when the cart was swapped.
+void cartdev_invalidate(void);
+
+// Forgets the cache before the arena it's in is released. cartdev_init()
+// has to be called again before reading.
+void cartdev_close(void);
+
+// Returns CTRCARD_OK or the CTRCARD_ERR_* of the failed cart read.
+int cartdev_read(u64 offset, u32 size, void* dest);
+
+const struct CartDevStats* cartdev_stats(void);
+
+// Prints the statistics, for the log after the cache has been used
+void cartdev_report(void);
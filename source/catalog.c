@@ -0,0 +1,77 @@
+#include "catalog.h"
+#include "cartdev.h"
+#include "fatfs/ff.h"
+#include "gamecart/protocol_ctr.h"
+
+#include <stdio.h>
+
+// flags[5] of the NCCH header
+#define NCCH_CONTENT_EXECUTABLE 0x02u
+
+static u64 title_id(const u8* id) {
+    u64 value;
+    memcpy(&value, id, sizeof(value));
+    return value;
+}
+
+// Partition number, offset and size in media units, partition ID and
+// whether it's a CXI or CFA, as its own header says
+static int format_partition(char* out, size_t size, const NCSD_HEADER* ncsd, u32 index, u32 media_unit) {
+    const partition_offsetsize* partition = &ncsd->offsetsize_table[index];
+    u32 header_data[0x200 / 4];
+    const NCCH_HEADER* header = (const NCCH_HEADER*)header_data;
+    const char* kind = "?";
+
+    if (cartdev_read((u64)partition->offset * media_unit, sizeof(header_data), header_data) == CTRCARD_OK &&
+        !memcmp(header->magic, "NCCH", 4))
+        kind = (header->flags[5] & NCCH_CONTENT_EXECUTABLE) ? "cxi" : "cfa";
+
+    return snprintf(out, size, " %lu:%08lX+%08lX:%016llX:%s", (unsigned long)index,
+                    (unsigned long)partition->offset, (unsigned long)partition->size,
+                    title_id(ncsd->partition_id_table[index]), kind);
+}
+
+int catalog_append(const char* path, const NCSD_HEADER* ncsd, const NCCH_HEADER* ncch, u32 cart_id,
+                   u32 media_unit) {
+    char line[512];
+    int len = 0;
+
+    // The first fields are fixed width, so the file lines up
+    u64 size = 0;
+    for (u32 i = 0; i < 8; ++i)
+        size += ncsd->offsetsize_table[i].size;
+    size = (size + ncsd->offsetsize_table[0].offset) * media_unit;
+    len = snprintf(line, sizeof(line), "%-16.16s %016llX %08lX %12llu %5lu", (const char*)ncch->product_code,
+                   title_id(ncsd->title_id), (unsigned long)cart_id, size, (unsigned long)media_unit);
+
+    for (u32 i = 0; i < 8 && len > 0 && (size_t)len < sizeof(line); ++i) {
+        if (ncsd->offsetsize_table[i].size != 0)
+            len += format_partition(line + len, sizeof(line) - len, ncsd, i, media_unit);
+    }
+    if (len < 0 || (size_t)len >= sizeof(line) - 1)
+        return -1;
+    line[len++] = '\n';
+
+    FIL fp;
+    if (f_open(&fp, path, FA_WRITE | FA_OPEN_ALWAYS) != FR_OK)
+        return -1;
+
+    static const char header[] =
+        "# product        title id         cart id          size  unit partition:offset+size:id:type\n";
+    UINT written = 0;
+    FRESULT res = FR_OK;
+    if (f_size(&fp) == 0) {
+        res = f_write(&fp, header, sizeof(header) - 1, &written);
+        if (res == FR_OK && written != sizeof(header) - 1)
+            res = FR_DENIED;
+    }
+    if (res == FR_OK)
+        res = f_lseek(&fp, f_size(&fp));
+    if (res == FR_OK)
+        res = f_write(&fp, line, len, &written);
+    if (res == FR_OK && written != (UINT)len)
+        res = FR_DENIED;
+
+    FRESULT close_res = f_close(&fp);
+    return res == FR_OK && close_res == FR_OK ? 0 : -1;
+}
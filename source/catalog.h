@@ -0,0 +1,14 @@
+#pragma once
+
+#include "common.h"
+#include "headers.h"
+
+// Catalog of carts for intake of a collection, a text line per cart that
+// is appended to the file without touching what's in it already.
+#define CATALOG_PATH "/uncart_catalog.txt"
+
+// Reads the NCCH headers of the partitions through the cart cache and
+// appends the record of the cart to the catalog. The SD card must be
+// mounted. Returns 0, or -1 if the catalog couldn't be written.
+int catalog_append(const char* path, const NCSD_HEADER* ncsd, const NCCH_HEADER* ncch, u32 cart_id,
+                   u32 media_unit);
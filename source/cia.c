@@ -0,0 +1,169 @@
+#include "cia.h"
+#include "sha.h"
+
+#define CIA_ALIGN           0x40u
+#define CIA_HEADER_SIZE     0x2020u
+// CA, ticket signer and TMD signer certificates. Left empty: nothing here
+// is signed, so installing needs signature checks patched out either way.
+#define CIA_CERT_SIZE       0xA00u
+#define CIA_TICKET_SIZE     0x350u
+
+// RSA-2048 with SHA-256, the signature is left empty
+#define SIG_TYPE_RSA2048    0x00010004u
+#define SIG_BLOCK_SIZE      0x140u
+
+#define TMD_HEADER_SIZE     0xC4u
+#define TMD_INFO_RECORDS    64u
+#define TMD_INFO_SIZE       0x24u
+#define TMD_CHUNK_SIZE      0x30u
+#define TMD_TITLE_TYPE_CTR  0x40u
+
+static const char ticket_issuer[] = "Root-CA00000003-XS0000000c";
+static const char tmd_issuer[] = "Root-CA00000003-CP0000000b";
+
+// Ticket content index granting all contents, as the eShop issues it
+static const u8 ticket_content_index[0x24] = {
+    0x00, 0x01, 0x00, 0x14, 0x00, 0x00, 0x00, 0xAC, 0x00, 0x00, 0x00, 0x14,
+    0x00, 0x01, 0x00, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x28,
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x84, 0x00, 0x00, 0x00, 0x84,
+};
+
+static u32 align_up(u32 value) {
+    return (value + CIA_ALIGN - 1) & ~(CIA_ALIGN - 1);
+}
+
+static void put_le32(u8* p, u32 value) {
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+static void put_le64(u8* p, u64 value) {
+    put_le32(p, (u32)value);
+    put_le32(p + 4, (u32)(value >> 32));
+}
+
+static void put_be16(u8* p, u16 value) {
+    p[0] = value >> 8;
+    p[1] = value;
+}
+
+static void put_be32(u8* p, u32 value) {
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+static void put_be64(u8* p, u64 value) {
+    put_be32(p, (u32)(value >> 32));
+    put_be32(p + 4, (u32)value);
+}
+
+void cia_init(struct CiaBuilder* cia, const NCSD_HEADER* ncsd, u32 media_unit) {
+    memset(cia, 0, sizeof(*cia));
+    for (int i = 0; i < 8; ++i)
+        cia->title_id[i] = ncsd->title_id[7 - i];
+
+    cia->cert_offset = align_up(CIA_HEADER_SIZE);
+    cia->ticket_offset = cia->cert_offset + align_up(CIA_CERT_SIZE);
+    cia->tmd_offset = cia->ticket_offset + align_up(CIA_TICKET_SIZE);
+
+    for (u32 i = 0; i < CIA_MAX_CONTENTS; ++i) {
+        const partition_offsetsize* partition = &ncsd->offsetsize_table[i];
+        if (partition->size == 0)
+            continue;
+
+        struct CiaContent* content = &cia->contents[cia->content_count++];
+        content->index = i;
+        content->start_sector = partition->offset;
+        content->end_sector = partition->offset + partition->size;
+        content->size = (u64)partition->size * media_unit;
+    }
+
+    cia->tmd_size = SIG_BLOCK_SIZE + TMD_HEADER_SIZE + TMD_INFO_RECORDS * TMD_INFO_SIZE +
+        cia->content_count * TMD_CHUNK_SIZE;
+    cia->content_offset = cia->tmd_offset + align_up(cia->tmd_size);
+
+    u64 offset = cia->content_offset;
+    for (u32 i = 0; i < cia->content_count; ++i) {
+        cia->contents[i].offset = offset;
+        offset += (cia->contents[i].size + CIA_ALIGN - 1) & ~(u64)(CIA_ALIGN - 1);
+    }
+    cia->total_size = offset;
+}
+
+static void write_sig_block(u8* p, const char* issuer) {
+    put_be32(p, SIG_TYPE_RSA2048);
+    memcpy(p + SIG_BLOCK_SIZE, issuer, strlen(issuer));
+}
+
+static void build_header(const struct CiaBuilder* cia, u8* p) {
+    put_le32(p + 0x00, CIA_HEADER_SIZE);
+    put_le32(p + 0x08, CIA_CERT_SIZE);
+    put_le32(p + 0x0C, CIA_TICKET_SIZE);
+    put_le32(p + 0x10, cia->tmd_size);
+    put_le32(p + 0x14, 0); // No meta
+    put_le64(p + 0x18, cia->total_size - cia->content_offset);
+    for (u32 i = 0; i < cia->content_count; ++i) {
+        const u32 index = cia->contents[i].index;
+        p[0x20 + index / 8] |= 0x80 >> (index % 8);
+    }
+}
+
+static void build_ticket(const struct CiaBuilder* cia, u8* p) {
+    write_sig_block(p, ticket_issuer);
+    u8* ticket = p + SIG_BLOCK_SIZE;
+
+    ticket[0x7C] = 1; // Format version
+    memcpy(ticket + 0x9C, cia->title_id, 8);
+    memcpy(ticket + 0x164, ticket_content_index, sizeof(ticket_content_index));
+    memset(ticket + 0x164 + sizeof(ticket_content_index), 0xFF, 0x80);
+}
+
+static int build_tmd(const struct CiaBuilder* cia, u8* p) {
+    write_sig_block(p, tmd_issuer);
+    u8* header = p + SIG_BLOCK_SIZE;
+    u8* info = header + TMD_HEADER_SIZE;
+    u8* chunks = info + TMD_INFO_RECORDS * TMD_INFO_SIZE;
+
+    header[0x40] = 1; // Format version
+    memcpy(header + 0x4C, cia->title_id, 8);
+    put_be32(header + 0x54, TMD_TITLE_TYPE_CTR);
+    put_be16(header + 0x9E, cia->content_count);
+
+    for (u32 i = 0; i < cia->content_count; ++i) {
+        const struct CiaContent* content = &cia->contents[i];
+        u8* chunk = chunks + i * TMD_CHUNK_SIZE;
+        put_be32(chunk + 0x00, content->index); // Content ID
+        put_be16(chunk + 0x04, content->index);
+        put_be16(chunk + 0x06, 0);              // Not encrypted
+        put_be64(chunk + 0x08, content->size);
+        memcpy(chunk + 0x10, content->hash, sizeof(content->hash));
+    }
+
+    // One info record covers all chunk records
+    put_be16(info + 0x00, 0);
+    put_be16(info + 0x02, cia->content_count);
+    if (sha_quick(info + 0x04, chunks, cia->content_count * TMD_CHUNK_SIZE, SHA_MODE_256) != SHA_OK)
+        return SHA_ERR_TIMEOUT;
+    return sha_quick(header + 0xA4, info, TMD_INFO_RECORDS * TMD_INFO_SIZE, SHA_MODE_256);
+}
+
+FRESULT cia_write_headers(const struct CiaBuilder* cia, FIL* fp, u8* scratch) {
+    UINT written = 0;
+
+    memset(scratch, 0, cia->content_offset);
+    build_header(cia, scratch);
+    build_ticket(cia, scratch + cia->ticket_offset);
+    if (build_tmd(cia, scratch + cia->tmd_offset) != SHA_OK)
+        return FR_INT_ERR;
+
+    FRESULT res = f_lseek(fp, 0);
+    if (res == FR_OK)
+        res = f_write(fp, scratch, cia->content_offset, &written);
+    if (res == FR_OK && written != cia->content_offset)
+        res = FR_DENIED;
+    return res;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "common.h"
+#include "headers.h"
+#include "fatfs/ff.h"
+
+// CIA output. The layout is fixed from the NCSD header before the dump,
+// the contents are then dumped straight to their place in the file and
+// hashed on the way. Header, certificate chain, ticket and TMD are written
+// last, once the hashes are known.
+
+// Main CXI, manual and download play child CFAs. The update partitions
+// don't go into a CIA.
+#define CIA_MAX_CONTENTS 3
+
+struct CiaContent {
+    u32 index;
+    u32 start_sector; // In cart media units
+    u32 end_sector;
+    u64 offset;       // In the CIA file
+    u64 size;
+    u8 hash[32];
+};
+
+struct CiaBuilder {
+    u8 title_id[8];   // Big endian
+    u32 content_count;
+    struct CiaContent contents[CIA_MAX_CONTENTS];
+
+    u32 cert_offset;
+    u32 ticket_offset;
+    u32 tmd_offset;
+    u32 tmd_size;
+    u32 content_offset; // Also the size of everything before the contents
+    u64 total_size;
+};
+
+void cia_init(struct CiaBuilder* cia, const NCSD_HEADER* ncsd, u32 media_unit);
+
+// Writes everything but the contents to the start of the file, built in
+// scratch, which must hold content_offset bytes. The content hashes must
+// have been filled in. Returns FR_OK or the FatFs error.
+FRESULT cia_write_headers(const struct CiaBuilder* cia, FIL* fp, u8* scratch);
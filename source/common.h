@@ -22,6 +22,14 @@ typedef volatile u16 vu16;
 typedef volatile u32 vu32;
 typedef volatile u64 vu64;
 
+// Hot loops are built as ARM code, the rest of the payload is Thumb. ARM
+// code has the barrel shifter and all registers, which matters for hashing.
+#ifdef __arm__
+#define ARM_CODE __attribute__((target("arm")))
+#else
+#define ARM_CODE
+#endif
+
 inline char* strupper(const char* str) {
     const size_t string_len = strlen(str);
     char* buffer = (char*)malloc(string_len + 1);
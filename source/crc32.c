@@ -0,0 +1,48 @@
+#include "crc32.h"
+
+// Slicing-by-4: four bytes per step through four tables. The tables take
+// 4KB, the whole data cache, eight would only thrash it.
+static u32 crc_table[4][256];
+static bool crc_table_ready = false;
+
+static void crc32_init_table(void) {
+    for (u32 i = 0; i < 256; ++i) {
+        u32 c = i;
+        for (int k = 0; k < 8; ++k)
+            c = (c & 1) ? (c >> 1) ^ 0xEDB88320u : c >> 1;
+        crc_table[0][i] = c;
+    }
+    for (u32 i = 0; i < 256; ++i) {
+        for (int t = 1; t < 4; ++t)
+            crc_table[t][i] = crc_table[0][crc_table[t - 1][i] & 0xFF] ^ (crc_table[t - 1][i] >> 8);
+    }
+    crc_table_ready = true;
+}
+
+ARM_CODE u32 crc32_update(u32 crc, const void* data, size_t size) {
+    if (!crc_table_ready)
+        crc32_init_table();
+
+    const u8* p = data;
+    crc = ~crc;
+    while (size > 0 && ((u32)p & 3)) {
+        crc = crc_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        size--;
+    }
+
+    // Little endian words, the first byte is in the low bits
+    const u32* words = (const u32*)p;
+    for (; size >= 8; size -= 8) {
+        crc ^= *words++;
+        crc = crc_table[3][crc & 0xFF] ^ crc_table[2][(crc >> 8) & 0xFF] ^
+            crc_table[1][(crc >> 16) & 0xFF] ^ crc_table[0][crc >> 24];
+        crc ^= *words++;
+        crc = crc_table[3][crc & 0xFF] ^ crc_table[2][(crc >> 8) & 0xFF] ^
+            crc_table[1][(crc >> 16) & 0xFF] ^ crc_table[0][crc >> 24];
+    }
+
+    p = (const u8*)words;
+    while (size--)
+        crc = crc_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
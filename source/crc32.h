@@ -0,0 +1,7 @@
+#pragma once
+
+#include "common.h"
+
+// Standard CRC-32 (reflected, polynomial 0xEDB88320), as used by zip.
+// Start with crc = 0 and feed the data in as many pieces as needed.
+u32 crc32_update(u32 crc, const void* data, size_t size);
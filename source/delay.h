@@ -1,9 +0,0 @@
-// Copyright 2014 Normmatt
-// Licensed under GPLv2 or any later version
-// Refer to the license.txt file included.
-
-#pragma once
-
-#include "common.h"
-
-void ioDelay(u32 us);
@@ -5,10 +5,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
-#include <stdio.h>
 
 #include "font.h"
 #include "draw.h"
+#include "format.h"
 
 size_t current_y = 0;
 
@@ -23,27 +23,83 @@ void ClearScreen(unsigned char *screen, int color)
     }
 }
 
-void DrawCharacter(unsigned char *screen, int character, size_t x, size_t y, int color, int bgcolor)
+// A column of a glyph is 8 pixels next to each other in the framebuffer,
+// bottom row first. Every possible column is expanded for the colors in
+// use, so a glyph is drawn as 8 copies of 24 bytes.
+#define TILE_SIZE (8 * BYTES_PER_PIXEL)
+
+static u32 tiles[256][TILE_SIZE / 4];
+static int tile_color, tile_bgcolor;
+static bool tiles_ready = false;
+
+// The font turned on its side, bit n of a column is row n of the glyph
+static u8 glyph_columns[256][8];
+static bool glyph_columns_ready = false;
+
+static void ExpandTiles(int color, int bgcolor)
 {
-    for (size_t yy = 0; yy < 8; yy++) {
-        size_t xDisplacement = (x * BYTES_PER_PIXEL * SCREEN_WIDTH);
-        size_t yDisplacement = ((SCREEN_WIDTH - (y + yy) - 1) * BYTES_PER_PIXEL);
-        
-	unsigned char *screenPos = screen + xDisplacement + yDisplacement;
-        unsigned char charPos = font[(size_t)character * 8 + yy];
-        for (int xx = 7; xx >= 0; xx--) {
-            if ((charPos >> xx) & 1) {
-                *(screenPos + 0) = color >> 16;  // B
-                *(screenPos + 1) = color >> 8;   // G
-                *(screenPos + 2) = color & 0xFF; // R
-            } else {
-                *(screenPos + 0) = bgcolor >> 16;  // B
-                *(screenPos + 1) = bgcolor >> 8;   // G
-                *(screenPos + 2) = bgcolor & 0xFF; // R
-            }
-            screenPos += BYTES_PER_PIXEL * SCREEN_WIDTH;
+    for (u32 column = 0; column < 256; column++) {
+        u8 *tile = (u8*)tiles[column];
+        for (int yy = 7; yy >= 0; yy--) {
+            int pixel = ((column >> yy) & 1) ? color : bgcolor;
+            *(tile++) = pixel >> 16;  // B
+            *(tile++) = pixel >> 8;   // G
+            *(tile++) = pixel & 0xFF; // R
         }
     }
+    tile_color = color;
+    tile_bgcolor = bgcolor;
+    tiles_ready = true;
+}
+
+static void TransposeFont(void)
+{
+    for (u32 c = 0; c < 256; c++) {
+        for (u32 xx = 0; xx < 8; xx++) {
+            u8 column = 0;
+            for (u32 yy = 0; yy < 8; yy++)
+                column |= ((font[c * 8 + yy] >> (7 - xx)) & 1) << yy;
+            glyph_columns[c][xx] = column;
+        }
+    }
+    glyph_columns_ready = true;
+}
+
+// As wide stores as the alignment of the line allows, which depends on y
+static void CopyTile(unsigned char *dest, const u32 *tile)
+{
+    switch ((u32)dest & 3) {
+        case 0:
+            for (size_t i = 0; i < TILE_SIZE / 4; i++)
+                ((u32*)dest)[i] = tile[i];
+            break;
+        case 2:
+            for (size_t i = 0; i < TILE_SIZE / 2; i++)
+                ((u16*)dest)[i] = ((const u16*)tile)[i];
+            break;
+        default:
+            for (size_t i = 0; i < TILE_SIZE; i++)
+                dest[i] = ((const u8*)tile)[i];
+            break;
+    }
+}
+
+void DrawCharacter(unsigned char *screen, int character, size_t x, size_t y, int color, int bgcolor)
+{
+    if (x + 8 > SCREEN_HEIGHT || y + 8 > SCREEN_WIDTH)
+        return;
+    if (!glyph_columns_ready)
+        TransposeFont();
+    if (!tiles_ready || color != tile_color || bgcolor != tile_bgcolor)
+        ExpandTiles(color, bgcolor);
+
+    const u8 *columns = glyph_columns[(u8)character];
+    unsigned char *screenPos = screen + x * BYTES_PER_PIXEL * SCREEN_WIDTH +
+        (SCREEN_WIDTH - y - 8) * BYTES_PER_PIXEL;
+    for (size_t xx = 0; xx < 8; xx++) {
+        CopyTile(screenPos, tiles[columns[xx]]);
+        screenPos += BYTES_PER_PIXEL * SCREEN_WIDTH;
+    }
 }
 
 void DrawString(unsigned char *screen, const char *str, size_t x, size_t y, int color, int bgcolor)
@@ -54,37 +110,49 @@ void DrawString(unsigned char *screen, const char *str, size_t x, size_t y, int
         DrawCharacter(screen, str[i], x + i * 8, y, color, bgcolor);
 }
 
+// Under A9LH both top screen framebuffers are the same
+static void DrawStringTop(const char *str, size_t x, size_t y, int color, int bgcolor)
+{
+    DrawString(TOP_SCREEN0, str, x, y, color, bgcolor);
+    if (TOP_SCREEN1 != TOP_SCREEN0)
+        DrawString(TOP_SCREEN1, str, x, y, color, bgcolor);
+}
+
 void DrawStringF(size_t x, size_t y, const char *format, ...)
 {
     char str[256];
     va_list va;
 
     va_start(va, format);
-    vsnprintf(str, 256, format, va);
+    fmt_vformat(str, sizeof(str), format, va);
     va_end(va);
 
-    DrawString(TOP_SCREEN0, str, x, y, RGB(0, 0, 0), RGB(255, 255, 255));
-    DrawString(TOP_SCREEN1, str, x, y, RGB(0, 0, 0), RGB(255, 255, 255));
+    DrawStringTop(str, x, y, RGB(0, 0, 0), RGB(255, 255, 255));
 }
 
 void Debug(const char *format, ...)
 {
     char str[51];
-    const char* spaces = "                                                 X";
+    // Clears the next line, the X shows where the log goes on
+    static const char next_line[] = "                                                 X";
     va_list va;
 
     va_start(va, format);
-    vsnprintf(str, sizeof(str), format, va);
+    size_t len = fmt_vformat(str, sizeof(str), format, va);
     va_end(va);
-    snprintf(str, sizeof(str), "%s%s", str, spaces);
+    memset(str + len, ' ', sizeof(str) - 1 - len);
+    str[sizeof(str) - 1] = '\0';
 
-    DrawString(TOP_SCREEN0, str, 0u, current_y, RGB(255, 0, 0), RGB(255, 255, 255));
-    DrawString(TOP_SCREEN0, spaces, 0u, current_y + 10, RGB(255, 0, 0), RGB(255, 255, 255));
-    DrawString(TOP_SCREEN1, str, 0u, current_y, RGB(255, 0, 0), RGB(255, 255, 255));
-    DrawString(TOP_SCREEN1, spaces, 0u, current_y + 10, RGB(255, 0, 0), RGB(255, 255, 255));
+    DrawStringTop(str, 0u, current_y, RGB(255, 0, 0), RGB(255, 255, 255));
+    DrawStringTop(next_line, 0u, current_y + 10, RGB(255, 0, 0), RGB(255, 255, 255));
 
     current_y += 10;
     if (current_y >= 240) {
         current_y = 0;
     }
 }
+
+void DebugBlank(void)
+{
+    Debug(" ");
+}
@@ -34,7 +34,9 @@ void ClearScreen(unsigned char *screen, int color);
 void DrawCharacter(unsigned char *screen, int character, size_t x, size_t y, int color, int bgcolor);
 void DrawHex(unsigned char *screen, unsigned int hex, size_t x, size_t y, int color, int bgcolor);
 void DrawString(unsigned char *screen, const char *str, size_t x, size_t y, int color, int bgcolor);
-void DrawStringF(size_t x, size_t y, const char *format, ...);
+void DrawStringF(size_t x, size_t y, const char *format, ...) __attribute__((format(printf, 3, 4)));
 void DrawHexWithName(unsigned char *screen, const char *str, unsigned int hex, size_t x, size_t y, int color, int bgcolor);
 
-void Debug(const char *format, ...);
+void Debug(const char *format, ...) __attribute__((format(printf, 1, 2)));
+// An empty line in the log
+void DebugBlank(void);
@@ -0,0 +1,625 @@
+#include "dump.h"
+#include "cartdev.h"
+#include "crc32.h"
+#include "draw.h"
+#include "fatfs/sdmmc.h"
+#include "hid.h"
+#include "progress.h"
+#include "sha.h"
+#include "telemetry.h"
+#include "timer.h"
+#include "gamecart/protocol.h"
+#include "gamecart/command_ctr.h"
+#include "gamecart/protocol_ctr.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#define SD_SECTOR_SIZE 0x200u
+
+// How often re-initializing a cart that lost sync is tried before asking
+// the user, and how often one chunk is read again because of it.
+#define RESYNC_ATTEMPTS 3
+
+// How often a range that doesn't read back correctly is written again
+// before it's reported as bad.
+#define VERIFY_MAX_REWRITES 3
+
+// A range of the output file that has been written and synced, but not
+// read back yet. The dump buffer gets reused for the next chunk, so only
+// the CRC of what was written is kept.
+struct PendingVerify {
+    DWORD file_offset;
+    u32 sector;
+    u32 size;
+    u32 crc;
+};
+
+#define VERIFY_MAX_PENDING 64
+static struct PendingVerify pending[VERIFY_MAX_PENDING];
+static size_t pending_head = 0;
+static size_t pending_count = 0;
+
+// Error map, runs of consecutive sectors with the same outcome share an
+// entry. Runs past the end of the table are counted but not listed.
+#define MAP_MAX_ENTRIES 256
+
+struct MapEntry {
+    u32 sector;
+    u32 count;
+    u8 kind;
+    u8 reads; // Most reads any sector of the run needed
+};
+
+static struct MapEntry error_map[MAP_MAX_ENTRIES];
+static u32 map_entries = 0;
+static u32 map_dropped = 0;
+static u32 map_sectors[DUMP_ERROR_COUNT];
+
+static const char* const map_kind_names[] = {
+    [DUMP_ERROR_FIXED] = "fixed",
+    [DUMP_ERROR_BAD] = "bad",
+    [DUMP_ERROR_RETRIED] = "retried",
+    [DUMP_ERROR_CRC] = "crc",
+    [DUMP_ERROR_SHORT] = "short",
+    [DUMP_ERROR_TIMEOUT] = "timeout",
+};
+
+static void map_add(u32 sector, u32 count, enum DumpError kind, u32 reads) {
+    if (reads > 0xFF)
+        reads = 0xFF;
+
+    if (map_entries > 0) {
+        // Runs that touch or overlap the last one are merged into it, so
+        // sectors read more than once (dual-read) aren't listed twice
+        struct MapEntry* last = &error_map[map_entries - 1];
+        u32 last_end = last->sector + last->count;
+        if (last->kind == kind && sector >= last->sector && sector <= last_end) {
+            if (sector + count > last_end) {
+                map_sectors[kind] += sector + count - last_end;
+                last->count = sector + count - last->sector;
+            }
+            if (reads > last->reads)
+                last->reads = reads;
+            return;
+        }
+    }
+
+    map_sectors[kind] += count;
+
+    if (map_entries == MAP_MAX_ENTRIES) {
+        map_dropped++;
+        return;
+    }
+    error_map[map_entries++] = (struct MapEntry){ sector, count, kind, reads };
+}
+
+void dump_map_clear(void) {
+    map_entries = 0;
+    map_dropped = 0;
+    memset(map_sectors, 0, sizeof(map_sectors));
+}
+
+bool dump_map_empty(void) {
+    return map_entries == 0 && map_dropped == 0;
+}
+
+// Number of sectors recorded with the given outcome
+u32 dump_map_count(enum DumpError kind) {
+    return map_sectors[kind];
+}
+
+static int map_printf(FIL* fp, const char* format, ...) {
+    char line[80];
+    va_list va;
+
+    va_start(va, format);
+    int len = vsnprintf(line, sizeof(line), format, va);
+    va_end(va);
+    if (len < 0 || (size_t)len >= sizeof(line))
+        return -1;
+
+    unsigned int written = 0;
+    if (f_write(fp, line, len, &written) != FR_OK || written != (unsigned int)len)
+        return -1;
+    return 0;
+}
+
+// Writes the map as text, one run of sectors (in media units) per line.
+int dump_map_write(FIL* fp, const char* title) {
+    if (map_printf(fp, "# Uncart error map for %s\n", title) < 0 ||
+        map_printf(fp, "# sector    count     reads  result\n") < 0)
+        return -1;
+
+    for (u32 i = 0; i < map_entries; ++i) {
+        const struct MapEntry* entry = &error_map[i];
+        if (map_printf(fp, "%08lX  %08lX  %5u  %s\n", (unsigned long)entry->sector,
+                       (unsigned long)entry->count, entry->reads, map_kind_names[entry->kind]) < 0)
+            return -1;
+    }
+
+    if (map_dropped > 0 &&
+        map_printf(fp, "# %lu more runs not listed\n", (unsigned long)map_dropped) < 0)
+        return -1;
+    return 0;
+}
+
+// Reads with the normal timing first, then retries with slower timing
+// until a read succeeds or all backoff levels have been tried. A timeout
+// isn't retried, slower timing won't help a cart that's gone. Returns the
+// status of the last read and the number of reads made.
+static int cart_read_retry(u32 sector, u32 blocks, u8* dest, struct Context* ctx, u32* reads) {
+    u32 level = 0;
+    int res;
+
+    while (true) {
+        Cart_Dummy();
+        Cart_Dummy();
+        res = CTR_CmdReadData(sector, ctx->media_unit, blocks, dest);
+        telemetry_cart_read(res, level);
+        if (res == CTRCARD_OK || res == CTRCARD_ERR_TIMEOUT || level == CTR_READ_BACKOFF_LEVELS)
+            break;
+        CTR_SetReadBackoff(++level);
+    }
+
+    if (level > 0)
+        CTR_SetReadBackoff(0);
+    *reads = level + 1;
+    return res;
+}
+
+// Runs the cart init sequence again after the cart lost sync, and checks
+// that it's still the same cart.
+static bool cart_resync(const struct Context* ctx) {
+    u32 header[0x200 / 4];
+    u32 sec_keys[4];
+
+    for (int attempt = 0; attempt < RESYNC_ATTEMPTS; ++attempt) {
+        if (Cart_Init() != CTRCARD_OK || Cart_GetID() != ctx->cart_id)
+            continue;
+        if (CTR_CmdReadHeader(header) != CTRCARD_OK || memcmp(header, ctx->cart_header, sizeof(header)) != 0)
+            continue;
+
+        if (Cart_Secure_Init(header, sec_keys) == CTRCARD_OK && Cart_CheckSync())
+            return true;
+    }
+    return false;
+}
+
+// Makes sure the cart still answers, bringing it back in place if it
+// doesn't. Once the user gives up on it, or right away in batch mode, all
+// further reads are skipped.
+static void cart_sync(struct Context* ctx) {
+    if (ctx->cart_lost || Cart_CheckSync())
+        return;
+
+    Debug("Cart lost sync, re-initializing...");
+    while (!cart_resync(ctx)) {
+        if (ctx->batch) {
+            ctx->cart_lost = true;
+            return;
+        }
+        Debug("Reinsert the same cart. A: retry, B: give up");
+        if (!(InputWait() & BUTTON_A)) {
+            ctx->cart_lost = true;
+            return;
+        }
+    }
+    Debug("Cart is back, resuming.");
+    // It may have been out of the slot, don't trust what was cached
+    cartdev_invalidate();
+    ctx->resyncs++;
+    telemetry_resync();
+}
+
+static void map_read_result(u32 sector, u32 blocks, int res, u32 reads) {
+    switch (res) {
+        case CTRCARD_OK:
+            map_add(sector, blocks, DUMP_ERROR_RETRIED, reads);
+            break;
+        case CTRCARD_ERR_CRC:
+            map_add(sector, blocks, DUMP_ERROR_CRC, reads);
+            break;
+        case CTRCARD_ERR_TIMEOUT:
+            map_add(sector, blocks, DUMP_ERROR_TIMEOUT, reads);
+            break;
+        default:
+            map_add(sector, blocks, DUMP_ERROR_SHORT, reads);
+            break;
+    }
+}
+
+static void cart_read(u32 sector, u32 count, u8* dest, struct Context* ctx) {
+    const u32 read_size = 1u * 1024 * 1024 / ctx->media_unit; // 1MiB default
+    bool resynced = false;
+
+    while (count > 0 && !ctx->cart_lost) {
+        u32 blocks = count < read_size ? count : read_size;
+        u32 reads;
+        int res = cart_read_retry(sector, blocks, dest, ctx, &reads);
+
+        if (res != CTRCARD_OK && !resynced) {
+            // Errors that survive the retries are often a cart that lost
+            // sync, in which case the range is read again once it's back
+            u32 resyncs = ctx->resyncs;
+            cart_sync(ctx);
+            if (ctx->resyncs != resyncs) {
+                resynced = true;
+                continue;
+            }
+        }
+
+        if (res != CTRCARD_OK && res != CTRCARD_ERR_TIMEOUT && blocks > 1) {
+            // Narrow it down, so only the blocks that really fail are
+            // marked and the rest of the range gets good data
+            for (u32 i = 0; i < blocks; ++i) {
+                res = cart_read_retry(sector + i, 1, dest + i * ctx->media_unit, ctx, &reads);
+                if (reads > 1)
+                    map_read_result(sector + i, 1, res, reads);
+            }
+        } else if (reads > 1 || res != CTRCARD_OK) {
+            map_read_result(sector, blocks, res, reads);
+        }
+
+        sector += blocks;
+        count -= blocks;
+        dest += blocks * ctx->media_unit;
+        resynced = false;
+
+        // Chunks take seconds, a press would be missed between them
+        InputSample();
+    }
+}
+
+static bool blocks_equal(const u8* a, const u8* b, u32 size) {
+    const u32* wa = (const u32*)a;
+    const u32* wb = (const u32*)b;
+
+    for (u32 i = 0; i < size / 4; ++i) {
+        if (wa[i] != wb[i])
+            return false;
+    }
+    return true;
+}
+
+// Reads a block whose two copies differ again, until one version of it has
+// been seen twice, and keeps that one.
+static void vote_block(u32 sector, u8* block, const u8* second, struct Context* ctx) {
+    const u32 mu = ctx->media_unit;
+    const u8* copies[DUMP_VOTE_READS + 2] = { block, second };
+    u32 num_copies = 2;
+
+    for (u32 r = 0; r < DUMP_VOTE_READS; ++r) {
+        u8* copy = ctx->vote_buffer + r * mu;
+        cart_read(sector, 1, copy, ctx);
+
+        for (u32 i = 0; i < num_copies; ++i) {
+            if (blocks_equal(copies[i], copy, mu)) {
+                if (copies[i] != block)
+                    memcpy(block, copies[i], mu);
+                map_add(sector, 1, DUMP_ERROR_FIXED, r + 3);
+                return;
+            }
+        }
+        copies[num_copies++] = copy;
+    }
+
+    // No majority, keep the first copy
+    map_add(sector, 1, DUMP_ERROR_BAD, DUMP_VOTE_READS + 2);
+}
+
+// Reads the blocks that were just dumped a second time, a piece at a time,
+// and compares each piece with the first copy word by word. Only blocks
+// that differ are read again.
+static void dual_read_check(u32 sector, u32 count, u8* data, struct Context* ctx) {
+    const u32 mu = ctx->media_unit;
+    const u32 step = dump_compare_size(mu) / mu;
+
+    while (count > 0) {
+        u32 blocks = count < step ? count : step;
+        cart_read(sector, blocks, ctx->compare_buffer, ctx);
+
+        u32 mismatches = 0;
+        for (u32 i = 0; i < blocks; ++i) {
+            if (!blocks_equal(data + i * mu, ctx->compare_buffer + i * mu, mu))
+                mismatches++;
+        }
+
+        if (mismatches > blocks / 4) {
+            // Too many to be worn contacts, see if the cart lost sync. If it
+            // did, the caller reads the whole chunk again.
+            u32 resyncs = ctx->resyncs;
+            cart_sync(ctx);
+            if (ctx->resyncs != resyncs || ctx->cart_lost)
+                return;
+        }
+
+        for (u32 i = 0; i < blocks && mismatches > 0; ++i) {
+            if (!blocks_equal(data + i * mu, ctx->compare_buffer + i * mu, mu)) {
+                vote_block(sector + i, data + i * mu, ctx->compare_buffer + i * mu, ctx);
+                mismatches--;
+            }
+        }
+
+        sector += blocks;
+        count -= blocks;
+        data += blocks * mu;
+    }
+}
+
+// Reads part of the file straight from the SD card, bypassing FatFs and
+// any caching it does.
+static int sd_read_file(FIL* fp, DWORD offset, u32 size, u8* dest) {
+    while (size > 0) {
+        DWORD sect, nsect;
+        if (f_getsect(fp, offset, &sect, &nsect) != FR_OK)
+            return -1;
+
+        u32 count = size / SD_SECTOR_SIZE;
+        if (count > nsect)
+            count = nsect;
+        if (sdmmc_sdcard_readsectors(sect, count, dest))
+            return -1;
+
+        offset += count * SD_SECTOR_SIZE;
+        size -= count * SD_SECTOR_SIZE;
+        dest += count * SD_SECTOR_SIZE;
+    }
+    return 0;
+}
+
+static bool verify_range(FIL* fp, const struct PendingVerify* range, struct Context* ctx) {
+    if (sd_read_file(fp, range->file_offset, range->size, ctx->verify_buffer) < 0)
+        return false;
+    return crc32_update(0, ctx->verify_buffer, range->size) == range->crc;
+}
+
+// Puts the card info in the part of it the chunk covers
+static void fill_card_info(u32 sector, u8* data, u32 size, const struct Context* ctx) {
+    const u64 start = (u64)sector * ctx->media_unit;
+    const u64 end = start + size;
+    const u64 from = start > DUMP_CARD_INFO_START ? start : DUMP_CARD_INFO_START;
+    const u64 to = end < DUMP_CARD_INFO_END ? end : DUMP_CARD_INFO_END;
+
+    if (from < to)
+        memcpy(data + (from - start), ctx->card_info + (from - DUMP_CARD_INFO_START), (u32)(to - from));
+}
+
+// Dumps the range from the cart again and writes it back to the same place
+// in the file, until it reads back correctly.
+static bool rewrite_range(FIL* fp, const struct PendingVerify* range, struct Context* ctx) {
+    DWORD resume = f_tell(fp);
+    bool ok = false;
+
+    for (int attempt = 0; attempt < VERIFY_MAX_REWRITES && !ok && !ctx->cart_lost; ++attempt) {
+        ctx->verify_rewrites++;
+        cart_read(range->sector, range->size / ctx->media_unit, ctx->verify_buffer, ctx);
+        // The CRC is of what was written, so the cart data has to go through
+        // the same steps before it's compared
+        if (ctx->card_info != NULL)
+            fill_card_info(range->sector, ctx->verify_buffer, range->size, ctx);
+        if (ctx->decrypt != NULL &&
+            ncch_decrypt_chunk(ctx->decrypt, (u64)range->sector * ctx->media_unit, ctx->verify_buffer,
+                               range->size) < 0)
+            continue;
+        if (crc32_update(0, ctx->verify_buffer, range->size) != range->crc) {
+            Debug("Cart data changed at %08lX, re-reading", (unsigned long)range->sector);
+            cart_sync(ctx);
+            continue;
+        }
+
+        unsigned int bytes_written = 0;
+        if (f_lseek(fp, range->file_offset) != FR_OK ||
+            f_write(fp, ctx->verify_buffer, range->size, &bytes_written) != FR_OK ||
+            bytes_written != range->size || f_sync(fp) != FR_OK)
+            continue;
+
+        ok = verify_range(fp, range, ctx);
+    }
+
+    f_lseek(fp, resume);
+    return ok;
+}
+
+static void verify_next(FIL* fp, struct Context* ctx) {
+    const struct PendingVerify* range = &pending[pending_head];
+    const u32 start = timer_ticks();
+    pending_head = (pending_head + 1) % VERIFY_MAX_PENDING;
+    pending_count--;
+    telemetry_ring(pending_count, VERIFY_MAX_PENDING);
+
+    if (!verify_range(fp, range, ctx)) {
+        Debug("SD readback mismatch at 0x%08lX, rewriting", range->file_offset);
+        if (!rewrite_range(fp, range, ctx)) {
+            Debug("Couldn't fix 0x%lX bytes at 0x%08lX!", (DWORD)range->size, range->file_offset);
+            ctx->verify_failures++;
+        }
+    }
+    telemetry_stage(TELEMETRY_VERIFY, start, range->size);
+}
+
+// Queues the chunk that was just written for verification. The data is
+// still in the buffer at this point, so this is where the CRCs are taken.
+static void queue_verify(FIL* fp, DWORD file_offset, u32 sector, const u8* data, u32 size, struct Context* ctx) {
+    while (size > 0) {
+        u32 range_size = size < DUMP_VERIFY_SIZE ? size : DUMP_VERIFY_SIZE;
+
+        if (pending_count == VERIFY_MAX_PENDING)
+            verify_next(fp, ctx);
+
+        struct PendingVerify* range = &pending[(pending_head + pending_count) % VERIFY_MAX_PENDING];
+        range->file_offset = file_offset;
+        range->sector = sector;
+        range->size = range_size;
+        range->crc = crc32_update(0, data, range_size);
+        pending_count++;
+        telemetry_ring(pending_count, VERIFY_MAX_PENDING);
+
+        file_offset += range_size;
+        sector += range_size / ctx->media_unit;
+        data += range_size;
+        size -= range_size;
+    }
+}
+
+// Checked between chunks. Returns true if the dump is to be cancelled.
+static bool check_input(void) {
+    u32 pressed = InputPoll();
+
+    if (pressed & BUTTON_START) {
+        Debug("Paused. START: resume, B: cancel");
+        do {
+            pressed = InputPoll();
+        } while (!(pressed & (BUTTON_START | BUTTON_B)));
+        if (!(pressed & BUTTON_B))
+            Debug("Resuming.");
+    }
+    return pressed & BUTTON_B;
+}
+
+// Which of the dump options are on, for the telemetry screen
+static u32 telemetry_options(const struct Context* ctx) {
+    u32 options = 0;
+
+    if (ctx->compare_buffer != NULL)
+        options |= TELEMETRY_DUAL_READ;
+    if (ctx->verify_buffer != NULL)
+        options |= TELEMETRY_VERIFY_WRITES;
+    if (ctx->decrypt != NULL)
+        options |= TELEMETRY_DECRYPTED;
+    if (ctx->hash_output || ctx->hashes != NULL)
+        options |= TELEMETRY_HASHED;
+    return options;
+}
+
+int dump_cart_region(u32 start_sector, u32 end_sector, FIL* output_file, struct Context* ctx) {
+    u32 read_size = 1u * 1024 * 1024 / ctx->media_unit; // 1MiB default
+    u32 start;
+
+    telemetry_set_mode(ctx->media_unit, read_size, telemetry_options(ctx));
+    telemetry_draw();
+    Debug("START: pause, B: cancel");
+    InputPoll();
+    progress_start((u64)start_sector * ctx->media_unit, (u64)ctx->cart_size * ctx->media_unit);
+
+    // Dump remaining data
+    u32 current_sector = start_sector;
+    while (current_sector < end_sector) {
+        if (check_input()) {
+            progress_end((u64)current_sector * ctx->media_unit);
+            Debug("Cancelled, finishing what was written...");
+            while (pending_count > 0)
+                verify_next(output_file, ctx);
+            f_sync(output_file);
+            telemetry_draw();
+            return DUMP_CANCELLED;
+        }
+
+        u32 chunk_sector = current_sector;
+        DWORD chunk_offset = f_tell(output_file);
+        u32 chunk_resyncs = ctx->resyncs;
+        int chunk_attempts = 0;
+        u8* read_ptr;
+
+read_chunk:
+        read_ptr = ctx->buffer;
+        while (read_ptr < ctx->buffer + ctx->buffer_size && current_sector < end_sector) {
+            //If there is less data to read than the curren read_size, fix it
+            if (end_sector - current_sector < read_size)
+            {
+                read_size = end_sector - current_sector;
+            }
+            start = timer_ticks();
+            cart_read(current_sector, read_size, read_ptr, ctx);
+            if (ctx->compare_buffer != NULL)
+                dual_read_check(current_sector, read_size, read_ptr, ctx);
+            telemetry_stage(TELEMETRY_CART_READ, start, ctx->media_unit * read_size);
+            read_ptr += ctx->media_unit * read_size;
+            current_sector += read_size;
+            telemetry_buffer((u32)(read_ptr - ctx->buffer), ctx->buffer_size);
+            progress_update((u64)current_sector * ctx->media_unit);
+            telemetry_update();
+
+            // Check the previous chunk a piece at a time between cart reads
+            if (ctx->verify_buffer != NULL && pending_count > 0)
+                verify_next(output_file, ctx);
+        }
+
+        // A cart that lost sync may return garbage without any read errors,
+        // so check it before the chunk is committed
+        cart_sync(ctx);
+        if (ctx->cart_lost) {
+            Debug("Cart lost, dump aborted.");
+            pending_count = 0;
+            return -1;
+        }
+        if (ctx->resyncs != chunk_resyncs && ++chunk_attempts <= RESYNC_ATTEMPTS) {
+            Debug("Reading %08lX again...", (unsigned long)chunk_sector);
+            chunk_resyncs = ctx->resyncs;
+            current_sector = chunk_sector;
+            goto read_chunk;
+        }
+
+        if (ctx->card_info != NULL)
+            fill_card_info(chunk_sector, ctx->buffer, (u32)(read_ptr - ctx->buffer), ctx);
+
+        const u32 chunk_size = (u32)(read_ptr - ctx->buffer);
+
+        start = timer_ticks();
+        if (ctx->decrypt != NULL &&
+            ncch_decrypt_chunk(ctx->decrypt, (u64)chunk_sector * ctx->media_unit, ctx->buffer,
+                               chunk_size) < 0) {
+            Debug("Decryption failed, dump aborted.");
+            pending_count = 0;
+            return -1;
+        }
+        if (ctx->decrypt != NULL)
+            telemetry_stage(TELEMETRY_DECRYPT, start, chunk_size);
+
+        start = timer_ticks();
+        if (ctx->hash_output && sha_update(ctx->buffer, chunk_size) != SHA_OK) {
+            Debug("Hashing failed, dump aborted.");
+            pending_count = 0;
+            return -1;
+        }
+
+        if (ctx->hashes != NULL && multihash_update(ctx->hashes, ctx->buffer, chunk_size) != SHA_OK) {
+            Debug("Hashing failed, dump aborted.");
+            pending_count = 0;
+            return -1;
+        }
+        if (ctx->hash_output || ctx->hashes != NULL)
+            telemetry_stage(TELEMETRY_HASH, start, chunk_size);
+
+        start = timer_ticks();
+        u8* write_ptr = ctx->buffer;
+        while (write_ptr < read_ptr) {
+            unsigned int bytes_written = 0;
+            f_write(output_file, write_ptr, (size_t)(read_ptr - write_ptr), &bytes_written);
+
+            if (bytes_written == 0) {
+                Debug("Writing failed! :( SD full?");
+                pending_count = 0;
+                return -1;
+            }
+
+            write_ptr += bytes_written;
+        }
+
+        // Make sure everything is on the card before reading it back
+        if (ctx->verify_buffer != NULL)
+            f_sync(output_file);
+        telemetry_stage(TELEMETRY_SD_WRITE, start, chunk_size);
+        if (ctx->verify_buffer != NULL)
+            queue_verify(output_file, chunk_offset, chunk_sector, ctx->buffer, chunk_size, ctx);
+        telemetry_buffer(0, ctx->buffer_size);
+        telemetry_update();
+    }
+
+    while (pending_count > 0)
+        verify_next(output_file, ctx);
+
+    progress_end((u64)end_sector * ctx->media_unit);
+    telemetry_draw();
+    return 0;
+}
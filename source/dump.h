@@ -0,0 +1,102 @@
+#pragma once
+
+#include "common.h"
+#include "fatfs/ff.h"
+#include "multihash.h"
+#include "ncch.h"
+
+// Size of the ranges that are read back from the SD card and compared when
+// write verification is on. Also the size of the verify buffer.
+#define DUMP_VERIFY_SIZE (1u * 1024 * 1024)
+
+// Cart image range that card_info replaces
+#define DUMP_CARD_INFO_START 0x1000u
+#define DUMP_CARD_INFO_END   0x4000u
+
+// Number of extra reads of a block the two copies of which disagree in
+// dual-read mode, before giving up on it. The vote buffer holds this many
+// media units.
+#define DUMP_VOTE_READS 5
+
+// Dual-read mode reads the second copy in pieces of this size and compares
+// each against the first as it arrives, so only a piece is held at a time.
+#define DUMP_COMPARE_SIZE (16u * 1024)
+
+// Size of the compare buffer, which holds at least one media unit
+static inline u32 dump_compare_size(u32 media_unit) {
+    return media_unit > DUMP_COMPARE_SIZE ? media_unit : DUMP_COMPARE_SIZE;
+}
+
+// What happened to a run of cart sectors, for the error map
+enum DumpError {
+    DUMP_ERROR_FIXED,   // Copies disagreed, a majority was found
+    DUMP_ERROR_BAD,     // Copies disagreed, no majority
+    DUMP_ERROR_RETRIED, // Read failed, a retry succeeded
+    DUMP_ERROR_CRC,     // CRC errors on every retry
+    DUMP_ERROR_SHORT,   // Short transfers on every retry
+    DUMP_ERROR_TIMEOUT, // The cart stopped responding
+
+    DUMP_ERROR_COUNT
+};
+
+struct Context {
+    u8* buffer;
+    size_t buffer_size;
+
+    u32 cart_size;
+    u32 media_unit;
+
+    // Read-after-write verification of the output, off if verify_buffer is
+    // NULL. Holds DUMP_VERIFY_SIZE bytes.
+    u8* verify_buffer;
+    u32 verify_rewrites;
+    u32 verify_failures;
+
+    // Dual-read mode, off if compare_buffer is NULL. Every block is read
+    // twice and blocks that differ are voted on. compare_buffer holds
+    // dump_compare_size() bytes, vote_buffer DUMP_VOTE_READS media units.
+    u8* compare_buffer;
+    u8* vote_buffer;
+
+    // Used to bring the cart back in place if it loses sync. cart_header is
+    // the 0x200 byte NCCH header as read at the start.
+    u32 cart_id;
+    const u32* cart_header;
+    u32 resyncs;
+    bool cart_lost;
+
+    // Batch mode, nobody is waiting to answer prompts. A cart that can't be
+    // brought back is given up on instead of asking for it again.
+    bool batch;
+
+    // Decrypted dump, off if NULL. Chunks are decrypted after they have
+    // been read and checked, before they are written.
+    const struct NcchCrypto* decrypt;
+
+    // Everything written is also fed to the SHA engine, which the caller
+    // starts before and reads after dumping a region.
+    bool hash_output;
+
+    // Everything written is also fed to this, off if NULL. Takes the SHA
+    // engine, so it can't be on together with hash_output.
+    struct MultiHash* hashes;
+
+    // Written in place of the cart data at 0x1000-0x4000 of the image,
+    // which doesn't read back as anything useful. Off if NULL.
+    const u8* card_info;
+};
+
+// Returned when the user cancels a dump. Everything written up to there
+// is on the SD card and verified, if verification is on.
+#define DUMP_CANCELLED -2
+
+// Returns 0, -1 on errors or DUMP_CANCELLED. START pauses the dump between
+// chunks and B cancels it.
+int dump_cart_region(u32 start_sector, u32 end_sector, FIL* output_file, struct Context* ctx);
+
+// The error map collects the sectors that needed more than one read during
+// a dump, so they can be checked without dumping the cart again.
+void dump_map_clear(void);
+bool dump_map_empty(void);
+u32 dump_map_count(enum DumpError kind);
+int dump_map_write(FIL* fp, const char* title);
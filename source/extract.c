@@ -0,0 +1,367 @@
+#include "extract.h"
+#include "draw.h"
+#include "fatfs/ff.h"
+#include "gamecart/protocol_ctr.h"
+
+#include <stdio.h>
+
+#define EXTRACT_PATH_MAX        512
+
+#define NCCH_EXHEADER_OFFSET    0x200u
+#define NCCH_EXHEADER_SIZE      0x800u
+
+#define EXEFS_HEADER_SIZE       0x200u
+#define EXEFS_MAX_FILES         10
+
+// Level 3 starts after the IVFC header and master hash, aligned to its
+// block size
+#define IVFC_HEADER_SIZE        0x60u
+
+#define ROMFS_NONE              0xFFFFFFFFu
+
+struct ExefsFile {
+    char name[8];
+    u32 offset;
+    u32 size;
+};
+
+struct IvfcHeader {
+    char magic[4];
+    u32 magic_number;
+    u32 master_hash_size;
+    struct {
+        u64 offset;
+        u64 size;
+        u32 block_size_log2;
+        u32 reserved;
+    } __attribute__((__packed__)) levels[3];
+} __attribute__((__packed__));
+
+struct RomfsHeader {
+    u32 header_size;
+    u32 dir_hash_offset;
+    u32 dir_hash_size;
+    u32 dir_meta_offset;
+    u32 dir_meta_size;
+    u32 file_hash_offset;
+    u32 file_hash_size;
+    u32 file_meta_offset;
+    u32 file_meta_size;
+    u32 file_data_offset;
+};
+
+struct RomfsDir {
+    u32 parent;
+    u32 sibling;
+    u32 child;
+    u32 file;
+    u32 hash_next;
+    u32 name_size;
+    u16 name[];
+};
+
+struct RomfsFile {
+    u32 parent;
+    u32 sibling;
+    u64 offset;
+    u64 size;
+    u32 hash_next;
+    u32 name_size;
+    u16 name[];
+} __attribute__((__packed__));
+
+// What's being extracted, the tables are kept in the front of the buffer
+struct Extraction {
+    const struct NcchCrypto* crypto;
+    u8* dir_meta;
+    u32 dir_meta_size;
+    u8* file_meta;
+    u32 file_meta_size;
+    u64 file_data; // Cart offset of the RomFS file data
+    u8* data;      // What's left of the buffer
+    u32 data_size;
+    u32 files;
+};
+
+static u32 getle32(const u8* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24);
+}
+
+// FatFs here only knows ASCII, anything else becomes '_'
+static void append_name(char* path, const void* name, u32 name_size) {
+    size_t length = strlen(path);
+
+    if (length + 1 < EXTRACT_PATH_MAX)
+        path[length++] = '/';
+    for (u32 i = 0; i < name_size / 2 && length + 1 < EXTRACT_PATH_MAX; ++i) {
+        u16 c;
+        memcpy(&c, (const u8*)name + i * 2, sizeof(c));
+        path[length++] = (c >= 0x20 && c < 0x7F && !strchr("\"*:<>?\\|", c)) ? (char)c : '_';
+    }
+    path[length] = '\0';
+}
+
+static FRESULT make_dir(const char* path) {
+    FRESULT res = f_mkdir(path);
+    return res == FR_EXIST ? FR_OK : res;
+}
+
+// Streams size bytes of decrypted cart data at offset into a new file
+static int extract_file(struct Extraction* ex, const char* path, u64 offset, u64 size) {
+    FIL fp;
+    UINT written;
+
+    if (f_open(&fp, path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+        Debug("Failed to create \"%s\"", path);
+        return -1;
+    }
+
+    int res = 0;
+    while (size > 0 && res == 0) {
+        const u32 length = size < ex->data_size ? (u32)size : ex->data_size;
+        if (ncch_read(ex->crypto, offset, length, ex->data) != CTRCARD_OK) {
+            Debug("Failed to read \"%s\" from the cart", path);
+            res = -1;
+        } else if (f_write(&fp, ex->data, length, &written) != FR_OK || written != length) {
+            Debug("Failed to write \"%s\"", path);
+            res = -1;
+        }
+        offset += length;
+        size -= length;
+    }
+
+    f_close(&fp);
+    ex->files++;
+    return res;
+}
+
+static int extract_exefs(struct Extraction* ex, u64 start, const char* dir) {
+    struct ExefsFile files[EXEFS_MAX_FILES];
+    char path[EXTRACT_PATH_MAX];
+
+    if (ncch_read(ex->crypto, start, sizeof(files), files) != CTRCARD_OK) {
+        Debug("Failed to read the ExeFS header");
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/exefs", dir);
+    if (make_dir(path) != FR_OK) {
+        Debug("Failed to create \"%s\"", path);
+        return -1;
+    }
+
+    // Files are stored in header order
+    for (u32 i = 0; i < EXEFS_MAX_FILES; ++i) {
+        if (files[i].size == 0)
+            continue;
+        snprintf(path, sizeof(path), "%s/exefs/%.8s", dir, files[i].name);
+        if (extract_file(ex, path, start + EXEFS_HEADER_SIZE + files[i].offset, files[i].size) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+// Entries are only used once they're known to be inside their table
+static const struct RomfsDir* romfs_dir(const struct Extraction* ex, u32 offset) {
+    if (offset == ROMFS_NONE || (u64)offset + sizeof(struct RomfsDir) > ex->dir_meta_size)
+        return NULL;
+    const struct RomfsDir* entry = (const struct RomfsDir*)(ex->dir_meta + offset);
+    if ((u64)offset + sizeof(struct RomfsDir) + entry->name_size > ex->dir_meta_size)
+        return NULL;
+    return entry;
+}
+
+static const struct RomfsFile* romfs_file(const struct Extraction* ex, u32 offset) {
+    if (offset == ROMFS_NONE || (u64)offset + sizeof(struct RomfsFile) > ex->file_meta_size)
+        return NULL;
+    const struct RomfsFile* entry = (const struct RomfsFile*)(ex->file_meta + offset);
+    if ((u64)offset + sizeof(struct RomfsFile) + entry->name_size > ex->file_meta_size)
+        return NULL;
+    return entry;
+}
+
+// Builds the path of a directory from its parents, the root being base
+static void dir_path(const struct Extraction* ex, u32 offset, const char* base, char* path) {
+    u32 chain[64];
+    u32 depth = 0;
+
+    while (offset != 0 && depth < sizeof(chain) / sizeof(chain[0])) {
+        const struct RomfsDir* entry = romfs_dir(ex, offset);
+        if (entry == NULL)
+            break;
+        chain[depth++] = offset;
+        offset = entry->parent;
+    }
+
+    strcpy(path, base);
+    while (depth > 0) {
+        const struct RomfsDir* entry = romfs_dir(ex, chain[--depth]);
+        append_name(path, entry->name, entry->name_size);
+    }
+}
+
+// Creates the directory tree, depth first without recursion, and collects
+// the file entries in files
+static int romfs_make_dirs(const struct Extraction* ex, const char* base, u32* files, u32 max_files,
+                           u32* file_count) {
+    char path[EXTRACT_PATH_MAX];
+    u32 offset = 0; // Root
+    u32 visited = 0;
+
+    *file_count = 0;
+    while (offset != ROMFS_NONE) {
+        const struct RomfsDir* entry = romfs_dir(ex, offset);
+        // Guards against loops in a broken table
+        if (entry == NULL || ++visited > ex->dir_meta_size / sizeof(struct RomfsDir))
+            return -1;
+
+        dir_path(ex, offset, base, path);
+        if (make_dir(path) != FR_OK) {
+            Debug("Failed to create \"%s\"", path);
+            return -1;
+        }
+
+        for (u32 file = entry->file; file != ROMFS_NONE;) {
+            const struct RomfsFile* file_entry = romfs_file(ex, file);
+            if (file_entry == NULL || *file_count == max_files)
+                return -1;
+            files[(*file_count)++] = file;
+            file = file_entry->sibling;
+        }
+
+        // Next: first child, else the next sibling of this or a parent
+        if (entry->child != ROMFS_NONE) {
+            offset = entry->child;
+            continue;
+        }
+        while (offset != 0) {
+            const struct RomfsDir* current = romfs_dir(ex, offset);
+            if (current == NULL)
+                return -1;
+            if (current->sibling != ROMFS_NONE) {
+                offset = current->sibling;
+                break;
+            }
+            offset = current->parent;
+        }
+        if (offset == 0)
+            offset = ROMFS_NONE;
+    }
+    return 0;
+}
+
+static const struct Extraction* sort_ex;
+
+static int compare_files(const void* a, const void* b) {
+    const u64 offset_a = romfs_file(sort_ex, *(const u32*)a)->offset;
+    const u64 offset_b = romfs_file(sort_ex, *(const u32*)b)->offset;
+    return offset_a < offset_b ? -1 : offset_a > offset_b;
+}
+
+static int extract_romfs(struct Extraction* ex, u64 start, const char* dir) {
+    struct IvfcHeader ivfc;
+    struct RomfsHeader header;
+    char base[EXTRACT_PATH_MAX];
+    char path[EXTRACT_PATH_MAX];
+
+    if (ncch_read(ex->crypto, start, sizeof(ivfc), &ivfc) != CTRCARD_OK || memcmp(ivfc.magic, "IVFC", 4)) {
+        Debug("RomFS header is not readable");
+        return -1;
+    }
+
+    const u32 block_size = 1u << ivfc.levels[2].block_size_log2;
+    const u64 level3 = start + ((IVFC_HEADER_SIZE + ivfc.master_hash_size + block_size - 1) & ~(u64)(block_size - 1));
+    if (ncch_read(ex->crypto, level3, sizeof(header), &header) != CTRCARD_OK) {
+        Debug("Failed to read the RomFS header");
+        return -1;
+    }
+
+    // The tables go to the front of the buffer, the file list after them
+    const u32 dir_size = (header.dir_meta_size + 3) & ~3u;
+    const u32 file_size = (header.file_meta_size + 3) & ~3u;
+    if ((u64)dir_size + file_size + 0x100000 > ex->data_size) {
+        Debug("RomFS tables are too large");
+        return -1;
+    }
+    ex->dir_meta = ex->data;
+    ex->dir_meta_size = header.dir_meta_size;
+    ex->file_meta = ex->data + dir_size;
+    ex->file_meta_size = header.file_meta_size;
+    ex->file_data = level3 + header.file_data_offset;
+    if (ncch_read(ex->crypto, level3 + header.dir_meta_offset, header.dir_meta_size, ex->dir_meta) != CTRCARD_OK ||
+        ncch_read(ex->crypto, level3 + header.file_meta_offset, header.file_meta_size, ex->file_meta) != CTRCARD_OK) {
+        Debug("Failed to read the RomFS tables");
+        return -1;
+    }
+
+    u32* files = (u32*)(ex->data + dir_size + file_size);
+    const u32 max_files = header.file_meta_size / sizeof(struct RomfsFile) + 1;
+    u32 file_count;
+    snprintf(base, sizeof(base), "%s/romfs", dir);
+    if (romfs_make_dirs(ex, base, files, max_files, &file_count) < 0) {
+        Debug("RomFS directory table is broken");
+        return -1;
+    }
+
+    // Front to back on the cart
+    sort_ex = ex;
+    qsort(files, file_count, sizeof(u32), compare_files);
+
+    u8* const tables = ex->data;
+    const u32 tables_size = dir_size + file_size + ((file_count * sizeof(u32) + 31) & ~31u);
+    ex->data = tables + tables_size;
+    ex->data_size -= tables_size;
+
+    int res = 0;
+    for (u32 i = 0; i < file_count && res == 0; ++i) {
+        const struct RomfsFile* entry = romfs_file(ex, files[i]);
+        dir_path(ex, entry->parent, base, path);
+        append_name(path, entry->name, entry->name_size);
+        if (i % 64 == 0)
+            Debug("RomFS file %lu / %lu", (unsigned long)(i + 1), (unsigned long)file_count);
+        res = extract_file(ex, path, ex->file_data + entry->offset, entry->size);
+    }
+
+    ex->data = tables;
+    ex->data_size += tables_size;
+    return res;
+}
+
+int extract_partition(const struct NcchCrypto* crypto, u64 base, const char* dir, u8* buffer,
+                      u32 buffer_size) {
+    u32 header_data[0x200 / 4];
+    const NCCH_HEADER* header = (const NCCH_HEADER*)header_data;
+    char path[EXTRACT_PATH_MAX];
+
+    struct Extraction ex = {
+        .crypto = crypto,
+        .data = buffer,
+        .data_size = buffer_size,
+    };
+
+    if (ncch_read(crypto, base, sizeof(header_data), header_data) != CTRCARD_OK ||
+        memcmp(header->magic, "NCCH", 4)) {
+        Debug("No NCCH header at %08llX", base);
+        return -1;
+    }
+    if (make_dir(dir) != FR_OK) {
+        Debug("Failed to create \"%s\"", dir);
+        return -1;
+    }
+
+    const u32 unit = 0x200u << header->flags[6];
+    if (getle32(header->extended_header_size) != 0) {
+        snprintf(path, sizeof(path), "%s/exheader.bin", dir);
+        if (extract_file(&ex, path, base + NCCH_EXHEADER_OFFSET, NCCH_EXHEADER_SIZE) < 0)
+            return -1;
+    }
+    if (getle32(header->exefs_size) != 0 &&
+        extract_exefs(&ex, base + (u64)getle32(header->exefs_offset) * unit, dir) < 0)
+        return -1;
+    if (getle32(header->romfs_size) != 0 &&
+        extract_romfs(&ex, base + (u64)getle32(header->romfs_offset) * unit, dir) < 0)
+        return -1;
+
+    Debug("Extracted %lu files.", (unsigned long)ex.files);
+    return 0;
+}
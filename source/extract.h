@@ -0,0 +1,13 @@
+#pragma once
+
+#include "common.h"
+#include "ncch.h"
+
+// Extracts the exheader, ExeFS files and RomFS file tree of the partition
+// at cart offset base into dir on the SD card, which must be mounted. The
+// partition has to be readable through crypto. Files are extracted in cart
+// order, so the cart is read front to back. buffer holds the RomFS tables
+// and the data on its way to the SD card, it should be a few MB.
+// Returns 0, or -1 after printing what failed.
+int extract_partition(const struct NcchCrypto* crypto, u64 base, const char* dir, u8* buffer,
+                      u32 buffer_size);
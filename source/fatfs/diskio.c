@@ -24,7 +24,8 @@ DSTATUS disk_initialize (
     BYTE pdrv               /* Physical drive nmuber (0..) */
 )
 {
-    sdmmc_sdcard_init();
+    if (sdmmc_sdcard_init())
+        return STA_NOINIT;
     return RES_OK;
 }
 
@@ -138,6 +138,80 @@ const unsigned short Tbl[] = {  /*  CP437(0x80-0xFF) to Unicode conversion table
     0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0
 };
 
+/* Reverse of Tbl[] as a two-level paged table, so that Unicode to OEM
+/  conversion takes constant time. All mapped characters are below U+2600.
+/  Identical 32-character pages are stored once. */
+static
+const BYTE Uni2OemDir[] = {  /* Unicode(0x0000-0x25FF) >> 5 to page of Uni2OemPage[] */
+     0,  0,  0,  0,  0,  1,  2,  3,  0,  0,  0,  0,  4,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  5,  6,  7,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  8,  0,  9,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    10, 11, 12, 13,  0,  0,  0,  0, 14, 15,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0, 16, 17, 18, 19, 20, 21,  0,  0
+};
+
+static
+const BYTE Uni2OemPage[][32] = {  /* Unicode & 0x1F to CP437 code (0:Not mapped) */
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0xFF, 0xAD, 0x9B, 0x9C, 0x00, 0x9D, 0x00, 0x00, 0x00, 0x00, 0xA6, 0xAE, 0xAA, 0x00, 0x00, 0x00,
+      0xF8, 0xF1, 0xFD, 0x00, 0x00, 0xE6, 0x00, 0xFA, 0x00, 0x00, 0xA7, 0xAF, 0xAC, 0xAB, 0x00, 0xA8 },
+    { 0x00, 0x00, 0x00, 0x00, 0x8E, 0x8F, 0x92, 0x80, 0x00, 0x90, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0xA5, 0x00, 0x00, 0x00, 0x00, 0x99, 0x00, 0x00, 0x00, 0x00, 0x00, 0x9A, 0x00, 0x00, 0xE1 },
+    { 0x85, 0xA0, 0x83, 0x00, 0x84, 0x86, 0x91, 0x87, 0x8A, 0x82, 0x88, 0x89, 0x8D, 0xA1, 0x8C, 0x8B,
+      0x00, 0xA4, 0x95, 0xA2, 0x93, 0x00, 0x94, 0xF6, 0x00, 0x97, 0xA3, 0x96, 0x81, 0x00, 0x00, 0x98 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x9F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0xE2, 0x00, 0x00, 0x00, 0x00, 0xE9, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0xE4, 0x00, 0x00, 0xE8, 0x00, 0x00, 0xEA, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0xE0, 0x00, 0x00, 0xEB, 0xEE, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0xE3, 0x00, 0x00, 0xE5, 0xE7, 0x00, 0xED, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFC },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x9E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF9, 0xFB, 0x00, 0x00, 0x00, 0xEC, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xEF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF7, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0xF0, 0x00, 0x00, 0xF3, 0xF2, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0xA9, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0xF4, 0xF5, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0xC4, 0x00, 0xB3, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xDA, 0x00, 0x00, 0x00,
+      0xBF, 0x00, 0x00, 0x00, 0xC0, 0x00, 0x00, 0x00, 0xD9, 0x00, 0x00, 0x00, 0xC3, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0xB4, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xC2, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0xC1, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xC5, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0xCD, 0xBA, 0xD5, 0xD6, 0xC9, 0xB8, 0xB7, 0xBB, 0xD4, 0xD3, 0xC8, 0xBE, 0xBD, 0xBC, 0xC6, 0xC7 },
+    { 0xCC, 0xB5, 0xB6, 0xB9, 0xD1, 0xD2, 0xCB, 0xCF, 0xD0, 0xCA, 0xD8, 0xD7, 0xCE, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0xDF, 0x00, 0x00, 0x00, 0xDC, 0x00, 0x00, 0x00, 0xDB, 0x00, 0x00, 0x00, 0xDD, 0x00, 0x00, 0x00,
+      0xDE, 0xB0, 0xB1, 0xB2, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0xFE, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }
+};
+
 DWORD get_fattime (void) {
     // fixed valid time of 1980-01-01 00:00:00
     return 0x210000;
@@ -159,10 +233,7 @@ WCHAR ff_convert (  /* Converted character, Returns zero on error */
             c = (src >= 0x100) ? 0 : Tbl[src - 0x80];
 
         } else {        /* Unicode to OEMCP */
-            for (c = 0; c < 0x80; c++) {
-                if (src == Tbl[c]) break;
-            }
-            c = (c + 0x80) & 0xFF;
+            c = (src >= 0x2600) ? 0 : Uni2OemPage[Uni2OemDir[src >> 5]][src & 0x1F];
         }
     }
 
@@ -1299,6 +1370,19 @@ FRESULT dir_next (  /* FR_OK:Succeeded, FR_NO_FILE:End of table, FR_DENIED:Could
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Directory handling - Check if the directory has a valid name index    */
+/*-----------------------------------------------------------------------*/
+
+#if _USE_DIRINDEX
+#define DIX_VALID(dp)   ((dp)->fs->dixtbl && (dp)->fs->dixid == (dp)->fs->id && (dp)->sclust == (dp)->fs->dixclust)
+#define DIX_DELETED     0xFFFFFFFF  /* Slot of a removed name (keeps probe sequences intact) */
+#define DIX_NONE        0xFFFFFFFF  /* No free entry found yet while building */
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Directory handling - Reserve directory entry                          */
 /*-----------------------------------------------------------------------*/
@@ -1311,10 +1395,14 @@ FRESULT dir_alloc (
 )
 {
     FRESULT res;
-    UINT n;
+    UINT n, start = 0;
 
 
-    res = dir_sdi(dp, 0);
+#if _USE_DIRINDEX
+    if (DIX_VALID(dp) && dp->fs->dixfree)   /* Skip the entries known to be in use */
+        start = dp->fs->dixfree - 1;        /* (this one always exists, so the table can be stretched) */
+#endif
+    res = dir_sdi(dp, start);
     if (res == FR_OK) {
         n = 0;
         do {
@@ -1328,6 +1416,10 @@ FRESULT dir_alloc (
             res = dir_next(dp, 1);      /* Next entry with table stretch enabled */
         } while (res == FR_OK);
     }
+#if _USE_DIRINDEX
+    if (res == FR_OK && DIX_VALID(dp) && dp->index + 1u - nent <= dp->fs->dixfree)
+        dp->fs->dixfree = dp->index + 1u;   /* The lowest free block has been taken */
+#endif
     if (res == FR_NO_FILE) res = FR_DENIED; /* No directory entry to allocate */
     return res;
 }
@@ -1559,13 +1651,155 @@ BYTE sum_sfn (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Directory handling - Name index                                       */
+/*-----------------------------------------------------------------------*/
+#if _USE_DIRINDEX
+static
+DWORD dix_hash_sfn (    /* Hash value of an SFN */
+    const BYTE* sfn     /* Pointer to the 11-byte SFN body */
+)
+{
+    DWORD h = 0x811C9DC5;
+    UINT n = 11;
+
+    do h = (h ^ *sfn++) * 0x01000193;
+    while (--n);
+    return h;
+}
+
+
+#if _USE_LFN
+static
+DWORD dix_hash_lfn (    /* Hash value of an LFN (case insensitive) */
+    const WCHAR* lfn    /* Pointer to the null-terminated LFN */
+)
+{
+    DWORD h = 0x811C9DC5;
+
+    while (*lfn)
+        h = (h ^ ff_wtoupper(*lfn++)) * 0x01000193;
+    return h;
+}
+#endif
+
+
+static
+DWORD dix_slot (    /* Slot value of a name: b31-16:tag (1..0xFFFE), b15-0:SFN entry index */
+    DWORD hash,     /* Hash value of the name */
+    UINT idx        /* Index of the SFN entry */
+)
+{
+    return ((hash >> 16) % 0xFFFE + 1) << 16 | (idx & 0xFFFF);
+}
+
+
+static
+int dix_insert (    /* 1:Inserted, 0:Table full (the index is dropped) */
+    FATFS* fs,      /* Pointer to the file system object */
+    DWORD hash,     /* Hash value of the name */
+    UINT idx        /* Index of the SFN entry */
+)
+{
+    DWORD *tbl = fs->dixtbl;
+    UINT i, mask = fs->dixsize - 1;
+
+
+    if ((fs->dixused + 1) * 4 > fs->dixsize * 3) {  /* Keep the load factor below 3/4 */
+        fs->dixtbl = 0;
+        return 0;
+    }
+    for (i = hash & mask; tbl[i] && tbl[i] != DIX_DELETED; i = (i + 1) & mask) ;
+    if (!tbl[i]) fs->dixused++;     /* Deleted slots are already counted */
+    tbl[i] = dix_slot(hash, idx);
+    return 1;
+}
+
+
+static
+void dix_erase (
+    FATFS* fs,      /* Pointer to the file system object */
+    DWORD hash,     /* Hash value of the name */
+    UINT idx        /* Index of the SFN entry */
+)
+{
+    DWORD v, *tbl = fs->dixtbl;
+    UINT i, mask = fs->dixsize - 1;
+
+
+    v = dix_slot(hash, idx);
+    for (i = hash & mask; tbl[i]; i = (i + 1) & mask) {
+        if (tbl[i] == v) {
+            tbl[i] = DIX_DELETED;
+            break;
+        }
+    }
+}
+
+
+#if !_FS_READONLY
+static
+void dix_add (      /* Add the object just registered to the index */
+    DIR* dp         /* Directory object pointing the SFN entry of the new object */
+)
+{
+#if _USE_LFN
+    if ((dp->fn[NS] & NS_LFN) && !dix_insert(dp->fs, dix_hash_lfn(dp->lfn), dp->index))
+        return;
+#endif
+    dix_insert(dp->fs, dix_hash_sfn(dp->fn), dp->index);
+}
+
+
+static
+FRESULT dix_remove (    /* Remove the object about to be deleted from the index */
+    DIR* dp             /* Directory object pointing the SFN entry of the object */
+)
+{
+    FRESULT res;
+    UINT i = dp->index, start = i;
+#if _USE_LFN
+    WCHAR lfn[_MAX_LFN+1];
+#endif
+
+
+    res = move_window(dp->fs, dp->sect);
+    if (res != FR_OK) return res;
+    dix_erase(dp->fs, dix_hash_sfn(dp->dir), i);
+#if _USE_LFN
+    if (dp->lfn_idx != 0xFFFF) {    /* Collect the LFN from its entries */
+        start = dp->lfn_idx;
+        res = dir_sdi(dp, start);
+        while (res == FR_OK && dp->index < i) {
+            res = move_window(dp->fs, dp->sect);
+            if (res != FR_OK) break;
+            if (!pick_lfn(lfn, dp->dir)) break;
+            res = dir_next(dp, 0);
+        }
+        if (res == FR_OK && dp->index == i)
+            dix_erase(dp->fs, dix_hash_lfn(lfn), i);
+        if (res == FR_NO_FILE) res = FR_INT_ERR;
+        if (res != FR_OK) return res;
+    }
+#endif
+    if (start < dp->fs->dixfree) dp->fs->dixfree = start;
+
+    return FR_OK;
+}
+#endif
+#endif /* _USE_DIRINDEX */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Directory handling - Find an object in the directory                  */
 /*-----------------------------------------------------------------------*/
 
 static
-FRESULT dir_find (
-    DIR* dp         /* Pointer to the directory object linked to the file name */
+FRESULT dir_scan (  /* FR_OK:Found, FR_NO_FILE:Not found up to the last entry */
+    DIR* dp,        /* Pointer to the directory object positioned at the first entry to check */
+    UINT last       /* Index of the last entry to check */
 )
 {
     FRESULT res;
@@ -1574,9 +1808,6 @@ FRESULT dir_find (
     BYTE a, ord, sum;
 #endif
 
-    res = dir_sdi(dp, 0);           /* Rewind directory object */
-    if (res != FR_OK) return res;
-
 #if _USE_LFN
     ord = sum = 0xFF;
 #endif
@@ -1616,6 +1847,10 @@ FRESULT dir_find (
         if (!(dir[DIR_Attr] & AM_VOL) && !mem_cmp(dir, dp->fn, 11)) /* Is it a valid entry? */
             break;
 #endif
+        if (dp->index >= last) {
+            res = FR_NO_FILE;       /* Checked all entries requested */
+            break;
+        }
         res = dir_next(dp, 0);      /* Next entry */
     } while (res == FR_OK);
 
@@ -1623,6 +1858,61 @@ FRESULT dir_find (
 }
 
 
+#if _USE_DIRINDEX
+static
+FRESULT dix_find (  /* Find an object with the name index of the directory */
+    DIR* dp         /* Pointer to the directory object linked to the file name */
+)
+{
+    FRESULT res;
+    DWORD hash[2], v, *tbl = dp->fs->dixtbl;
+    UINT i, k, n = 0, idx, mask = dp->fs->dixsize - 1;
+
+
+#if _USE_LFN
+    if (dp->lfn) hash[n++] = dix_hash_lfn(dp->lfn);
+    if (!(dp->fn[NS] & NS_LOSS)) hash[n++] = dix_hash_sfn(dp->fn);
+#else
+    hash[n++] = dix_hash_sfn(dp->fn);
+#endif
+    for (k = 0; k < n; k++) {
+        for (i = hash[k] & mask; (v = tbl[i]) != 0; i = (i + 1) & mask) {
+            if (v == DIX_DELETED || (v ^ dix_slot(hash[k], 0)) >> 16) continue;
+            idx = v & 0xFFFF;
+            /* Check the candidate with its LFN entries in front of it */
+#if _USE_LFN
+            res = dir_sdi(dp, idx > (_MAX_LFN + 12) / 13 ? idx - (_MAX_LFN + 12) / 13 : 0);
+#else
+            res = dir_sdi(dp, idx);
+#endif
+            if (res == FR_OK) res = dir_scan(dp, idx);
+            if (res != FR_NO_FILE) return res;  /* Found or error */
+        }
+    }
+
+    return FR_NO_FILE;  /* The index has every name in the directory */
+}
+#endif
+
+
+static
+FRESULT dir_find (
+    DIR* dp         /* Pointer to the directory object linked to the file name */
+)
+{
+    FRESULT res;
+
+
+#if _USE_DIRINDEX
+    if (DIX_VALID(dp)) return dix_find(dp);
+#endif
+    res = dir_sdi(dp, 0);           /* Rewind directory object */
+    if (res != FR_OK) return res;
+
+    return dir_scan(dp, 0xFFFF);
+}
+
+
 
 
 /*-----------------------------------------------------------------------*/
@@ -1759,6 +2049,9 @@ FRESULT dir_register (  /* FR_OK:Successful, FR_DENIED:No free entry or too many
             dp->dir[DIR_NTres] = dp->fn[NS] & (NS_BODY | NS_EXT);   /* Put NT flag */
 #endif
             dp->fs->wflag = 1;
+#if _USE_DIRINDEX
+            if (DIX_VALID(dp)) dix_add(dp);
+#endif
         }
     }
 
@@ -1783,6 +2076,12 @@ FRESULT dir_remove (    /* FR_OK: Successful, FR_DISK_ERR: A disk error */
     UINT i;
 
     i = dp->index;  /* SFN index */
+#if _USE_DIRINDEX
+    if (DIX_VALID(dp)) {
+        res = dix_remove(dp);
+        if (res != FR_OK) return res;
+    }
+#endif
     res = dir_sdi(dp, (dp->lfn_idx == 0xFFFF) ? i : dp->lfn_idx);   /* Goto the SFN or top of the LFN entries */
     if (res == FR_OK) {
         do {
@@ -1798,6 +2097,12 @@ FRESULT dir_remove (    /* FR_OK: Successful, FR_DISK_ERR: A disk error */
     }
 
 #else           /* Non LFN configuration */
+#if _USE_DIRINDEX
+    if (DIX_VALID(dp)) {
+        res = dix_remove(dp);
+        if (res != FR_OK) return res;
+    }
+#endif
     res = dir_sdi(dp, dp->index);
     if (res == FR_OK) {
         res = move_window(dp->fs, dp->sect);
@@ -3272,6 +3577,66 @@ FRESULT f_lseek (
 
 
 
+
+/*-----------------------------------------------------------------------*/
+/* Get Physical Location of File Data                                    */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_getsect (
+    FIL* fp,        /* Pointer to the file object */
+    DWORD ofs,      /* File offset to be converted (must be in the file) */
+    DWORD* sect,    /* Pointer to return the physical sector number */
+    DWORD* nsect    /* Pointer to return the number of contiguous sectors from there */
+)
+{
+    FRESULT res;
+    DWORD cl, ncl, clst, csect;
+
+
+    res = validate(fp);                 /* Check validity of the object */
+    if (res != FR_OK) LEAVE_FF(fp->fs, res);
+    if (fp->err)                        /* Check error */
+        LEAVE_FF(fp->fs, (FRESULT)fp->err);
+    if (ofs >= fp->fsize)
+        LEAVE_FF(fp->fs, FR_INVALID_PARAMETER);
+
+    csect = ofs / SS(fp->fs) & (fp->fs->csize - 1); /* Sector offset in the cluster */
+    cl = ofs / SS(fp->fs) / fp->fs->csize;          /* Cluster order from top of the file */
+#if _USE_FASTSEEK
+    if (fp->cltbl) {    /* Look up the fragment in the CLMT */
+        DWORD *tbl = fp->cltbl + 1;
+
+        for (;;) {
+            ncl = *tbl++;
+            if (!ncl) LEAVE_FF(fp->fs, FR_INT_ERR);
+            if (cl < ncl) break;
+            cl -= ncl;
+            tbl++;
+        }
+        clst = *tbl + cl;
+        ncl -= cl;      /* Clusters left in the fragment */
+    } else
+#endif
+    {                   /* Follow the cluster chain */
+        clst = fp->sclust;
+        while (cl--) {
+            clst = get_fat(fp->fs, clst);
+            if (clst == 0xFFFFFFFF) LEAVE_FF(fp->fs, FR_DISK_ERR);
+            if (clst <= 1 || clst >= fp->fs->n_fatent) LEAVE_FF(fp->fs, FR_INT_ERR);
+        }
+        ncl = 1;
+    }
+
+    *sect = clust2sect(fp->fs, clst);
+    if (!*sect) LEAVE_FF(fp->fs, FR_INT_ERR);
+    *sect += csect;
+    *nsect = ncl * fp->fs->csize - csect;
+
+    LEAVE_FF(fp->fs, FR_OK);
+}
+
+
+
 #if _FS_MINIMIZE <= 1
 /*-----------------------------------------------------------------------*/
 /* Create a Directory Object                                             */
@@ -3402,6 +3767,118 @@ FRESULT f_readdir (
 
 
 
+
+#if _USE_DIRINDEX
+/*-----------------------------------------------------------------------*/
+/* Build Name Index of a Directory                                       */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_indexdir (
+    const TCHAR* path,  /* Pointer to the directory path */
+    DWORD* tbl,         /* Pointer to the hash table buffer (NULL:Drop the index) */
+    UINT nslot          /* Number of DWORD slots in the table (power of 2) */
+)
+{
+    FRESULT res;
+    DIR dj;
+    FATFS* fs;
+    BYTE c, a, *dir;
+    DWORD blank;
+#if _USE_LFN
+    BYTE ord = 0xFF, sum = 0xFF;
+#endif
+    DEF_NAMEBUF;
+
+
+    /* Get logical drive number */
+    res = find_volume(&dj.fs, &path, 0);
+    if (res == FR_OK) {
+        fs = dj.fs;
+        if (!tbl) {                             /* Drop the current index */
+            fs->dixtbl = 0;
+            LEAVE_FF(fs, FR_OK);
+        }
+        if (nslot < 4 || (nslot & (nslot - 1))) LEAVE_FF(fs, FR_INVALID_PARAMETER);
+        INIT_BUF(dj);
+        res = follow_path(&dj, path);           /* Follow the path to the directory */
+        if (res == FR_OK && dj.dir) {           /* It is not the origin directory itself */
+            if (dj.dir[DIR_Attr] & AM_DIR)
+                dj.sclust = ld_clust(fs, dj.dir);
+            else
+                res = FR_NO_PATH;
+        }
+        if (res == FR_NO_FILE) res = FR_NO_PATH;
+        if (res == FR_OK && tbl == fs->dixtbl && nslot == fs->dixsize && DIX_VALID(&dj)) {
+            FREE_BUF();                         /* Already indexed on this mount, it is kept up to date */
+            LEAVE_FF(fs, FR_OK);
+        }
+        if (res == FR_OK) {
+            fs->dixtbl = 0;                     /* Drop the current index */
+            res = dir_sdi(&dj, 0);
+        }
+        if (res == FR_OK) {
+            mem_set(tbl, 0, nslot * sizeof (DWORD));
+            fs->dixtbl = tbl;
+            fs->dixsize = nslot;
+            fs->dixused = 0;
+            blank = DIX_NONE;
+            do {                                /* Register every object in the directory */
+                res = move_window(fs, dj.sect);
+                if (res != FR_OK) break;
+                dir = dj.dir;
+                c = dir[DIR_Name];
+                if (c == 0) {                   /* Reached to end of table */
+                    if (blank > dj.index) blank = dj.index;
+                    break;
+                }
+                a = dir[DIR_Attr] & AM_MASK;
+                if (c == DDE) {                 /* A blank entry */
+                    if (blank > dj.index) blank = dj.index;
+#if _USE_LFN
+                    ord = 0xFF;
+                } else if (a == AM_LFN) {       /* An LFN entry is found */
+                    if (c & LLE) {              /* Is it start of LFN sequence? */
+                        sum = dir[LDIR_Chksum];
+                        c &= ~LLE;
+                        ord = c;
+                    }
+                    ord = (c == ord && sum == dir[LDIR_Chksum] && pick_lfn(dj.lfn, dir)) ? ord - 1 : 0xFF;
+#endif
+                } else if (!(a & AM_VOL)) {     /* An SFN entry is found */
+#if _USE_LFN
+                    if (!ord && sum == sum_sfn(dir) && !dix_insert(fs, dix_hash_lfn(dj.lfn), dj.index)) {
+                        res = FR_NOT_ENOUGH_CORE;
+                        break;
+                    }
+                    ord = 0xFF;
+#endif
+                    if (!dix_insert(fs, dix_hash_sfn(dir), dj.index)) {
+                        res = FR_NOT_ENOUGH_CORE;
+                        break;
+                    }
+                }
+                res = dir_next(&dj, 0);         /* Next entry */
+                if (res == FR_NO_FILE) {        /* The table is full, next allocation stretches it */
+                    if (blank > dj.index + 1u) blank = dj.index + 1u;
+                    res = FR_OK;
+                    break;
+                }
+            } while (res == FR_OK);
+            if (res == FR_OK) {                 /* The index is complete */
+                fs->dixfree = (UINT)blank;
+                fs->dixclust = dj.sclust;
+                fs->dixid = fs->id;
+            } else {
+                fs->dixtbl = 0;
+            }
+        }
+        FREE_BUF();
+    }
+
+    LEAVE_FF(dj.fs, res);
+}
+#endif
+
 #if _FS_MINIMIZE == 0
 /*-----------------------------------------------------------------------*/
 /* Get File Status                                                       */
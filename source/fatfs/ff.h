@@ -103,6 +103,14 @@ typedef struct {
     DWORD   dirbase;        /* Root directory start sector (FAT32:Cluster#) */
     DWORD   database;       /* Data start sector */
     DWORD   winsect;        /* Current sector appearing in the win[] */
+#if _USE_DIRINDEX
+    DWORD*  dixtbl;         /* Directory name index hash table (NULL:No index) */
+    UINT    dixsize;        /* Number of slots in the index table (power of 2) */
+    UINT    dixused;        /* Number of used slots in the index table */
+    UINT    dixfree;        /* Entries below this index of the indexed directory are in use */
+    DWORD   dixclust;       /* Start cluster of the indexed directory (0:root) */
+    WORD    dixid;          /* File system mount ID the index was built on */
+#endif
     BYTE    win[_MAX_SS];   /* Disk access window for Directory, FAT (and file data at tiny cfg) */
 } FATFS;
 
@@ -212,6 +220,7 @@ FRESULT f_write (FIL* fp, const void* buff, UINT btw, UINT* bw);    /* Write dat
 FRESULT f_forward (FIL* fp, UINT(*func)(const BYTE*,UINT), UINT btf, UINT* bf); /* Forward data to the stream */
 FRESULT f_lseek (FIL* fp, DWORD ofs);                               /* Move file pointer of a file object */
 FRESULT f_truncate (FIL* fp);                                       /* Truncate file */
+FRESULT f_getsect (FIL* fp, DWORD ofs, DWORD* sect, DWORD* nsect);  /* Get physical sectors of file data */
 FRESULT f_sync (FIL* fp);                                           /* Flush cached data of a writing file */
 FRESULT f_opendir (DIR* dp, const TCHAR* path);                     /* Open a directory */
 FRESULT f_closedir (DIR* dp);                                       /* Close an open directory */
@@ -231,6 +240,7 @@ FRESULT f_setlabel (const TCHAR* label);                            /* Set volum
 FRESULT f_mount (FATFS* fs, const TCHAR* path, BYTE opt);           /* Mount/Unmount a logical drive */
 FRESULT f_mkfs (const TCHAR* path, BYTE sfd, UINT au);              /* Create a file system on the volume */
 FRESULT f_fdisk (BYTE pdrv, const DWORD szt[], void* work);         /* Divide a physical drive into some partitions */
+FRESULT f_indexdir (const TCHAR* path, DWORD* tbl, UINT nslot);     /* Build the name index of a directory */
 int f_putc (TCHAR c, FIL* fp);                                      /* Put a character to the file */
 int f_puts (const TCHAR* str, FIL* cp);                             /* Put a string to the file */
 int f_printf (FIL* fp, const TCHAR* str, ...);                      /* Put a formatted string to the file */
@@ -41,7 +41,7 @@
 /* To enable f_mkfs() function, set _USE_MKFS to 1 and set _FS_READONLY to 0 */
 
 
-#define _USE_FASTSEEK   0   /* 0:Disable or 1:Enable */
+#define _USE_FASTSEEK   1   /* 0:Disable or 1:Enable */
 /* To enable fast seek feature, set _USE_FASTSEEK to 1. */
 
 
@@ -53,6 +53,14 @@
 /* To enable f_forward() function, set _USE_FORWARD to 1 and set _FS_TINY to 1. */
 
 
+#define _USE_DIRINDEX   1   /* 0:Disable or 1:Enable */
+/* To enable the in-memory directory name index, set _USE_DIRINDEX to 1.
+/  f_indexdir() builds a hash table of the names in one directory per volume
+/  into a caller supplied buffer. While the index is valid, looking up,
+/  creating and removing objects in that directory does not scan it. Asking
+/  again for the directory already indexed on the same mount returns at once. */
+
+
 /*---------------------------------------------------------------------------/
 / Locale and Namespace Configurations
 /---------------------------------------------------------------------------*/
@@ -5,7 +5,18 @@
 #include "common.h"
 
 #include "sdmmc.h"
-#include "delay.h"
+#include "telemetry.h"
+#include "timer.h"
+
+// How long a command may take before it's given up on, plus 1ms per 512
+// bytes of data. Reported like any other command error.
+#define SDMMC_TIMEOUT_MS 1000u
+
+// How long a card may take to leave the busy state after power up
+#define SDMMC_INIT_TIMEOUT_MS 1000u
+
+// The card needs 1ms and 74 clocks after power up before the first command
+#define SDMMC_POWERUP_DELAY_US 2000u
 
 //Uncomment to enable 32bit fifo support?
 //not currently working
@@ -51,8 +62,16 @@ static void __attribute__((noinline)) sdmmc_send_command(struct mmcdevice *ctx,
     if (readdata || writedata)
         flags |= TMIO_STAT0_DATAEND;
 
+    struct Timeout timeout;
+    timeout_start(&timeout, SDMMC_TIMEOUT_MS + ((readdata || writedata) ? ctx->size >> 9 : 0));
+
     ctx->error = 0;
-    while (sdmmc_read16(REG_SDSTATUS1) & TMIO_STAT1_CMD_BUSY); //mmc working?
+    while (sdmmc_read16(REG_SDSTATUS1) & TMIO_STAT1_CMD_BUSY) { //mmc working?
+        if (timeout_expired(&timeout)) {
+            ctx->error |= 4;
+            return;
+        }
+    }
     sdmmc_write16(REG_SDIRMASK0,0);
     sdmmc_write16(REG_SDIRMASK1,0);
     sdmmc_write16(REG_SDSTATUS0,0);
@@ -149,6 +168,11 @@ static void __attribute__((noinline)) sdmmc_send_command(struct mmcdevice *ctx,
             if ((status0 & flags) == flags)
                 break;
         }
+
+        if (timeout_expired(&timeout)) {
+            ctx->error |= 4;
+            break;
+        }
     }
     ctx->stat0 = sdmmc_read16(REG_SDSTATUS0);
     ctx->stat1 = sdmmc_read16(REG_SDSTATUS1);
@@ -177,7 +201,9 @@ int __attribute__((noinline)) sdmmc_sdcard_writesectors(u32 sector_no, u32 numse
     sdmmc_write16(REG_SDBLKCOUNT,numsectors);
     handleSD.data = in;
     handleSD.size = numsectors << 9;
+    const u32 start = timer_ticks();
     sdmmc_send_command(&handleSD,0x52C19,sector_no);
+    telemetry_sd_command(true, start);
     return geterror(&handleSD);
 }
 
@@ -196,7 +222,9 @@ int __attribute__((noinline)) sdmmc_sdcard_readsectors(u32 sector_no, u32 numsec
     sdmmc_write16(REG_SDBLKCOUNT,numsectors);
     handleSD.data = out;
     handleSD.size = numsectors << 9;
+    const u32 start = timer_ticks();
     sdmmc_send_command(&handleSD,0x33C12,sector_no);
+    telemetry_sd_command(false, start);
     return geterror(&handleSD);
 }
 
@@ -354,13 +382,16 @@ static void InitSD()
 int Nand_Init()
 {
     inittarget(&handleNAND);
-    ioDelay(0xF000);
+    timer_delay_us(SDMMC_POWERUP_DELAY_US);
 
     sdmmc_send_command(&handleNAND,0,0);
 
+    struct Timeout timeout;
+    timeout_start(&timeout, SDMMC_INIT_TIMEOUT_MS);
     do {
         do {
             sdmmc_send_command(&handleNAND,0x10701,0x100000);
+            if (timeout_expired(&timeout)) return -1;
         } while ( !(handleNAND.error & 1) );
     } while((handleNAND.ret[0] & 0x80000000) == 0);
 
@@ -404,8 +435,7 @@ int Nand_Init()
 int SD_Init()
 {
     inittarget(&handleSD);
-    //ioDelay(0x3E8);
-    ioDelay(0xF000);
+    timer_delay_us(SDMMC_POWERUP_DELAY_US);
     sdmmc_send_command(&handleSD,0,0);
     sdmmc_send_command(&handleSD,0x10408,0x1AA);
     //u32 temp = (handleSD.ret[0] == 0x1AA) << 0x1E;
@@ -413,11 +443,14 @@ int SD_Init()
 
     //int count = 0;
     u32 temp2 = 0;
+    struct Timeout timeout;
+    timeout_start(&timeout, SDMMC_INIT_TIMEOUT_MS);
     do {
         do {
             sdmmc_send_command(&handleSD,0x10437,handleSD.initarg << 0x10);
             sdmmc_send_command(&handleSD,0x10769,0x00FF8000 | temp);
             temp2 = 1;
+            if (timeout_expired(&timeout)) return -1;
         } while ( !(handleSD.error & 1) );
 
     } while((handleSD.ret[0] & 0x80000000) == 0);
@@ -469,10 +502,11 @@ int SD_Init()
     return 0;
 }
 
+// Only the SD card's status is returned. Nothing here needs the NAND, so
+// a NAND that fails to come up mustn't keep the SD card from mounting.
 int sdmmc_sdcard_init()
 {
     InitSD();
-    int nand_res = Nand_Init();
-    int sd_res = SD_Init();
-    return nand_res | sd_res;
+    Nand_Init();
+    return SD_Init();
 }
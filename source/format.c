@@ -0,0 +1,137 @@
+#include "format.h"
+
+struct Output {
+    char* p;
+    char* end; // Room for the terminator is kept past this
+};
+
+static void put(struct Output* out, char c) {
+    if (out->p < out->end)
+        *out->p++ = c;
+}
+
+static void pad(struct Output* out, char c, int count) {
+    while (count-- > 0)
+        put(out, c);
+}
+
+// Digits go into the end of the buffer, most significant first
+static int digits(char* buf, u64 value, u32 base, bool upper) {
+    const char* set = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    int len = 0;
+
+    // 64-bit division is slow on the ARM9, most values fit 32 bits
+    if (value >> 32) {
+        do {
+            buf[23 - len++] = set[value % base];
+            value /= base;
+        } while (value >> 32);
+    }
+    u32 small = (u32)value;
+    do {
+        buf[23 - len++] = set[small % base];
+        small /= base;
+    } while (small != 0);
+    return len;
+}
+
+size_t fmt_vformat(char* buffer, size_t size, const char* format, va_list va) {
+    struct Output out = { buffer, buffer + (size > 0 ? size - 1 : 0) };
+
+    if (size == 0)
+        return 0;
+
+    for (const char* f = format; *f; ++f) {
+        if (*f != '%') {
+            put(&out, *f);
+            continue;
+        }
+
+        bool left = false, zero = false;
+        int width = 0, precision = -1, longs = 0;
+
+        for (++f; *f == '-' || *f == '0'; ++f) {
+            if (*f == '-')
+                left = true;
+            else
+                zero = true;
+        }
+        for (; *f >= '0' && *f <= '9'; ++f)
+            width = width * 10 + (*f - '0');
+        if (*f == '.') {
+            precision = 0;
+            for (++f; *f >= '0' && *f <= '9'; ++f)
+                precision = precision * 10 + (*f - '0');
+        }
+        for (; *f == 'l'; ++f)
+            longs++;
+
+        char buf[24];
+        const char* text = buf;
+        int len = 0;
+        bool negative = false;
+
+        switch (*f) {
+            case 'd':
+            case 'i': {
+                s64 value = longs >= 2 ? va_arg(va, s64) : longs ? va_arg(va, long) : va_arg(va, int);
+                negative = value < 0;
+                len = digits(buf, negative ? -(u64)value : (u64)value, 10, false);
+                text = buf + 24 - len;
+                break;
+            }
+            case 'u':
+            case 'x':
+            case 'X': {
+                u64 value = longs >= 2 ? va_arg(va, u64) : longs ? va_arg(va, unsigned long) : va_arg(va, unsigned);
+                len = digits(buf, value, *f == 'u' ? 10 : 16, *f == 'X');
+                text = buf + 24 - len;
+                break;
+            }
+            case 'c':
+                buf[0] = (char)va_arg(va, int);
+                len = 1;
+                break;
+            case 's':
+                text = va_arg(va, const char*);
+                if (text == NULL)
+                    text = "(null)";
+                while (text[len] && (precision < 0 || len < precision))
+                    len++;
+                break;
+            case '%':
+                buf[0] = '%';
+                len = 1;
+                break;
+            default:
+                // Unknown conversions are left out
+                if (*f == '\0')
+                    --f;
+                continue;
+        }
+
+        const int fill = width - len - negative;
+        if (!left && !zero)
+            pad(&out, ' ', fill);
+        if (negative)
+            put(&out, '-');
+        if (!left && zero)
+            pad(&out, '0', fill);
+        for (int i = 0; i < len; ++i)
+            put(&out, text[i]);
+        if (left)
+            pad(&out, ' ', fill);
+    }
+
+    *out.p = '\0';
+    return out.p - buffer;
+}
+
+size_t fmt_format(char* out, size_t size, const char* format, ...) {
+    va_list va;
+
+    va_start(va, format);
+    size_t len = fmt_vformat(out, size, format, va);
+    va_end(va);
+    return len;
+}
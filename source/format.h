@@ -0,0 +1,12 @@
+#pragma once
+
+#include "common.h"
+
+#include <stdarg.h>
+
+// printf style formatting for the log, without going through newlib's
+// stdio. Knows %d %i %u %x %X %c %s and %%, the '-' and '0' flags, field
+// widths, precision on strings and the l and ll lengths. The output is
+// cut to size and always terminated. Returns its length.
+size_t fmt_vformat(char* out, size_t size, const char* format, va_list va) __attribute__((format(printf, 3, 0)));
+size_t fmt_format(char* out, size_t size, const char* format, ...) __attribute__((format(printf, 3, 4)));
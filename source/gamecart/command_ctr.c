@@ -9,17 +9,36 @@
 
 static int read_count = 0;
 
-static inline void CTR_CmdC5()
+// Timing of the data read command. The low 13 bits are the delay before
+// the first word arrives; each backoff level adds to it, for carts that
+// give CRC errors at the normal speed.
+#define READ_LATENCY         0x704822Cu
+#define READ_LATENCY_DELAY   0x1FFFu
+#define READ_BACKOFF_STEP    0x400u
+
+static u32 read_latency = READ_LATENCY;
+
+void CTR_SetReadBackoff(u32 level)
+{
+    if(level > CTR_READ_BACKOFF_LEVELS)
+        level = CTR_READ_BACKOFF_LEVELS;
+    u32 delay = (READ_LATENCY & READ_LATENCY_DELAY) + level * READ_BACKOFF_STEP;
+    read_latency = (READ_LATENCY & ~READ_LATENCY_DELAY) | delay;
+}
+
+static inline int CTR_CmdC5()
 {
     static const u32 c5_cmd[4] = { 0xC5000000, 0x00000000, 0x00000000, 0x00000000 };
-    CTR_SendCommand(c5_cmd, 0, 1, 0x100002C, NULL);
+    return CTR_SendCommand(c5_cmd, 0, 1, 0x100002C, NULL);
 }
 
-void CTR_CmdReadData(u32 sector, u32 length, u32 blocks, void* buffer)
+int CTR_CmdReadData(u32 sector, u32 length, u32 blocks, void* buffer)
 {
     if(read_count++ > 10000)
     {
-        CTR_CmdC5();
+        int res = CTR_CmdC5();
+        if(res == CTRCARD_ERR_TIMEOUT)
+            return res;
         read_count = 0;
     }
 
@@ -28,13 +47,13 @@ void CTR_CmdReadData(u32 sector, u32 length, u32 blocks, void* buffer)
         (u32)((sector << 9) & 0xFFFFFFFF),
         0x00000000, 0x00000000
     };
-    CTR_SendCommand(read_cmd, length, blocks, 0x704822C, buffer);
+    return CTR_SendCommand(read_cmd, length, blocks, read_latency, buffer);
 }
 
-void CTR_CmdReadHeader(void* buffer)
+int CTR_CmdReadHeader(void* buffer)
 {
     static const u32 readheader_cmd[4] = { 0x82000000, 0x00000000, 0x00000000, 0x00000000 };
-    CTR_SendCommand(readheader_cmd, 0x200, 1, 0x704802C, buffer);
+    return CTR_SendCommand(readheader_cmd, 0x200, 1, 0x704802C, buffer);
 }
 
 u32 CTR_CmdGetSecureId(u32 rand1, u32 rand2)
@@ -45,8 +64,8 @@ u32 CTR_CmdGetSecureId(u32 rand1, u32 rand2)
     return id;
 }
 
-void CTR_CmdSeed(u32 rand1, u32 rand2)
+int CTR_CmdSeed(u32 rand1, u32 rand2)
 {
     const u32 seed_cmd[4] = { 0x83000000, 0x00000000, rand1, rand2 };
-    CTR_SendCommand(seed_cmd, 0, 1, 0x700822C, NULL);
+    return CTR_SendCommand(seed_cmd, 0, 1, 0x700822C, NULL);
 }
@@ -6,8 +6,14 @@
 
 #include "common.h"
 
+// Number of slower read timings CTR_SetReadBackoff() can select, 0 is the
+// normal timing.
+#define CTR_READ_BACKOFF_LEVELS 4
+
 void CTR_CmdReadSectorSD(u8* aBuffer, u32 aSector);
-void CTR_CmdReadData(u32 sector, u32 length, u32 blocks, void* buffer);
-void CTR_CmdReadHeader(void* buffer);
+// These return a CTRCARD_* status from protocol_ctr.h
+int CTR_CmdReadData(u32 sector, u32 length, u32 blocks, void* buffer);
+int CTR_CmdReadHeader(void* buffer);
+void CTR_SetReadBackoff(u32 level);
 u32 CTR_CmdGetSecureId(u32 rand1, u32 rand2);
-void CTR_CmdSeed(u32 rand1, u32 rand2);
+int CTR_CmdSeed(u32 rand1, u32 rand2);
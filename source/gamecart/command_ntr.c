@@ -6,22 +6,23 @@
 
 #include "protocol_ntr.h"
 
-void NTR_CmdReset(void)
+int NTR_CmdReset(void)
 {
     static const u32 reset_cmd[2] = { 0x9F000000, 0x00000000 };
-    NTR_SendCommand(reset_cmd, 0x2000, NTRCARD_CLK_SLOW | NTRCARD_DELAY1(0x1FFF) | NTRCARD_DELAY2(0x18), NULL);
+    return NTR_SendCommand(reset_cmd, 0x2000, NTRCARD_CLK_SLOW | NTRCARD_DELAY1(0x1FFF) | NTRCARD_DELAY2(0x18), NULL);
 }
 
 u32 NTR_CmdGetCartId(void)
 {
     u32 id;
     static const u32 getid_cmd[2] = { 0x90000000, 0x00000000 };
-    NTR_SendCommand(getid_cmd, 0x4, NTRCARD_CLK_SLOW | NTRCARD_DELAY1(0x1FFF) | NTRCARD_DELAY2(0x18), &id);
+    if (NTR_SendCommand(getid_cmd, 0x4, NTRCARD_CLK_SLOW | NTRCARD_DELAY1(0x1FFF) | NTRCARD_DELAY2(0x18), &id) != NTRCARD_OK)
+        return 0xFFFFFFFFu; // Same as an empty slot
     return id;
 }
 
-void NTR_CmdEnter16ByteMode(void)
+int NTR_CmdEnter16ByteMode(void)
 {
     static const u32 enter16bytemode_cmd[2] = { 0x3E000000, 0x00000000 };
-    NTR_SendCommand(enter16bytemode_cmd, 0x0, 0, NULL);
+    return NTR_SendCommand(enter16bytemode_cmd, 0x0, 0, NULL);
 }
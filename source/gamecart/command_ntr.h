@@ -6,6 +6,7 @@
 
 #include "common.h"
 
-void NTR_CmdReset(void);
+// These return a NTRCARD_* status from protocol_ntr.h
+int NTR_CmdReset(void);
 u32 NTR_CmdGetCartId(void);
-void NTR_CmdEnter16ByteMode(void);
+int NTR_CmdEnter16ByteMode(void);
@@ -15,9 +15,22 @@
 #include "protocol_ntr.h"
 #include "command_ctr.h"
 #include "command_ntr.h"
-#include "delay.h"
+#include "timer.h"
 
-extern u8* bottomScreen;
+// How long the slot may take to power cycle
+#define CART_SLOT_TIMEOUT_MS 500u
+
+// How long to keep polling for the cart to answer during init
+#define CART_READY_TIMEOUT_MS 250u
+
+// Settle times of the init sequence, in microseconds. Init polls for the
+// cart to be ready and only holds the reset for CART_RESET_HOLD_US, the
+// others are the fallback when that doesn't work.
+#define CART_RESET_HOLD_US      1000u
+#define CART_SWITCH_DELAY_US   10000u   // After changing the slot mode
+#define CART_RESET_DELAY_US    25000u   // With the cart held in reset
+#define CART_CTR_DELAY_US       5000u   // After switching to the CTR interface
+#define CART_SECURE_DELAY_US   20000u   // Between the secure init steps
 
 u32 CartID = 0xFFFFFFFFu;
 u32 CartType = 0;
@@ -33,24 +46,38 @@ u32 BSWAP32(u32 val) {
            ((val & 0xFF) << 24);
 }
 
+static int WaitCardConf2(u8 value, const struct Timeout* timeout)
+{
+    while (REG_CARDCONF2 != value) {
+        if (timeout_expired(timeout))
+            return CTRCARD_ERR_TIMEOUT;
+    }
+    return CTRCARD_OK;
+}
+
 // TODO: Verify
-static void ResetCartSlot(void)
+static int ResetCartSlot(void)
 {
+    struct Timeout timeout;
+    timeout_start(&timeout, CART_SLOT_TIMEOUT_MS);
+
     REG_CARDCONF2 = 0x0C;
     REG_CARDCONF &= ~3;
 
     if (REG_CARDCONF2 == 0xC) {
-        while (REG_CARDCONF2 != 0);
+        if (WaitCardConf2(0, &timeout) != CTRCARD_OK)
+            return CTRCARD_ERR_TIMEOUT;
     }
 
     if (REG_CARDCONF2 != 0)
-        return;
+        return CTRCARD_OK;
 
     REG_CARDCONF2 = 0x4;
-    while(REG_CARDCONF2 != 0x4);
+    if (WaitCardConf2(0x4, &timeout) != CTRCARD_OK)
+        return CTRCARD_ERR_TIMEOUT;
 
     REG_CARDCONF2 = 0x8;
-    while(REG_CARDCONF2 != 0x8);
+    return WaitCardConf2(0x8, &timeout);
 }
 
 static void SwitchToNTRCARD(void)
@@ -67,9 +94,10 @@ static void SwitchToCTRCARD(void)
     REG_CARDCONF = (REG_CARDCONF & ~3) | 2;
 }
 
+// Just the slot status, so it's cheap to poll and works before init
 int Cart_IsInserted(void)
 {
-    return (0x9000E2C2 == CTR_CmdGetSecureId(rand1, rand2) );
+    return !(REG_CARDCONF2 & CARD_EJECTED);
 }
 
 u32 Cart_GetID(void)
@@ -77,134 +105,157 @@ u32 Cart_GetID(void)
     return CartID;
 }
 
-void Cart_Init(void)
+static bool CartIdValid(u32 id)
 {
-    ResetCartSlot(); //Seems to reset the cart slot?
+    return id != 0 && id != 0xFFFFFFFFu;
+}
+
+// The CTR interface is up once the plaintext header can be read
+static int WaitCTRReady(void)
+{
+    u32 header[0x200 / 4];
+    struct Timeout timeout;
+
+    timeout_start(&timeout, CART_READY_TIMEOUT_MS);
+    do {
+        if (CTR_CmdReadHeader(header) == CTRCARD_OK && header[0x100 / 4] == 0x4843434E) // "NCCH"
+            return CTRCARD_OK;
+    } while (!timeout_expired(&timeout));
+    return CTRCARD_ERR_TIMEOUT;
+}
+
+static int CartInitSequence(bool slow)
+{
+    struct Timeout timeout;
+
+    if (ResetCartSlot() != CTRCARD_OK) //Seems to reset the cart slot?
+        return CTRCARD_ERR_TIMEOUT;
 
     REG_CTRCARDSECCNT &= 0xFFFFFFFB;
-    ioDelay(0x30000);
+    if (slow)
+        timer_delay_us(CART_SWITCH_DELAY_US);
 
     SwitchToNTRCARD();
-    ioDelay(0x30000);
+    if (slow)
+        timer_delay_us(CART_SWITCH_DELAY_US);
 
     REG_NTRCARDROMCNT = 0;
     REG_NTRCARDMCNT &= 0xFF;
-    ioDelay(0x40000);
+    timer_delay_us(slow ? CART_RESET_DELAY_US : CART_RESET_HOLD_US);
 
     REG_NTRCARDMCNT |= (NTRCARD_CR1_ENABLE | NTRCARD_CR1_IRQ);
     REG_NTRCARDROMCNT = NTRCARD_nRESET | NTRCARD_SEC_SEED;
-    while (REG_NTRCARDROMCNT & NTRCARD_BUSY);
+    timeout_start(&timeout, NTRCARD_TIMEOUT_MS);
+    while (REG_NTRCARDROMCNT & NTRCARD_BUSY) {
+        if (timeout_expired(&timeout))
+            return CTRCARD_ERR_TIMEOUT;
+    }
 
-    // Reset
-    NTR_CmdReset();
-    CartID = NTR_CmdGetCartId();
+    // Reset, until the cart comes up and answers with a sane ID
+    timeout_start(&timeout, CART_READY_TIMEOUT_MS);
+    do {
+        if (NTR_CmdReset() != NTRCARD_OK)
+            return CTRCARD_ERR_TIMEOUT;
+        CartID = NTR_CmdGetCartId();
+    } while (!CartIdValid(CartID) && !timeout_expired(&timeout));
+    if (!CartIdValid(CartID))
+        return CTRCARD_ERR_TIMEOUT;
 
     // 3ds
     if (CartID & 0x10000000) {
         u32 unknowna0_cmd[2] = { 0xA0000000, 0x00000000 };
-        NTR_SendCommand(unknowna0_cmd, 0x4, 0, &A0_Response);
+        if (NTR_SendCommand(unknowna0_cmd, 0x4, 0, &A0_Response) != NTRCARD_OK)
+            return CTRCARD_ERR_TIMEOUT;
 
-        NTR_CmdEnter16ByteMode();
+        if (NTR_CmdEnter16ByteMode() != NTRCARD_OK)
+            return CTRCARD_ERR_TIMEOUT;
         SwitchToCTRCARD();
-        ioDelay(0xF000);
+        if (slow)
+            timer_delay_us(CART_CTR_DELAY_US);
 
         REG_CTRCARDBLKCNT = 0;
+
+        // The fixed delay has to do without the header check, for carts
+        // with an odd header
+        if (!slow)
+            return WaitCTRReady();
     }
+    return CTRCARD_OK;
 }
 
-static void AES_SetKeyControl(u32 a) {
-    REG_AESKEYCNT = (REG_AESKEYCNT & 0xC0) | a | 0x80;
+int Cart_Init(void)
+{
+    // Poll for the cart first, and only fall back to the long fixed waits
+    // if it doesn't come up that way
+    if (CartInitSequence(false) == CTRCARD_OK)
+        return CTRCARD_OK;
+    return CartInitSequence(true);
 }
 
-//returns 1 if MAC valid otherwise 0
-static u8 card_aes(u32 *out, u32 *buff, size_t size) { // note size param ignored
-    u8 tmp = REG_AESKEYCNT;
-    REG_AESCNT = 0x10C00;    //flush r/w fifo macsize = 001
-
+//returns 1 if MAC valid otherwise 0, or CTRCARD_ERR_TIMEOUT
+static int card_aes(u32 *out, u32 *buff) {
     (*(vu8*)0x10000008) |= 0x0C; //???
 
-    REG_AESCNT |= 0x2800000;
-
     //const u8 is_dev_unit = *(vu8*)0x10010010;
     //if(is_dev_unit) //Dev unit
     const u8 is_dev_cart = (A0_Response&3)==3;
     if(is_dev_cart) //Dev unit
     {
-        AES_SetKeyControl(0x11);
-        REG_AESKEYFIFO = 0;
-        REG_AESKEYFIFO = 0;
-        REG_AESKEYFIFO = 0;
-        REG_AESKEYFIFO = 0;
-        REG_AESKEYSEL = 0x11;
+        static const u32 zero_key[4] = { 0 };
+        aes_setkey(AES_KEYSLOT_CART_DEV, zero_key, AES_KEY_NORMAL);
+        aes_use_keyslot(AES_KEYSLOT_CART_DEV);
     }
     else
     {
-        AES_SetKeyControl(0x3B);
-        REG_AESKEYYFIFO = buff[0];
-        REG_AESKEYYFIFO = buff[1];
-        REG_AESKEYYFIFO = buff[2];
-        REG_AESKEYYFIFO = buff[3];
-        REG_AESKEYSEL = 0x3B;
+        aes_setkey(AES_KEYSLOT_CART, buff, AES_KEY_Y);
+        aes_use_keyslot(AES_KEYSLOT_CART);
     }
 
-    REG_AESCNT = 0x4000000;
-    REG_AESCNT &= 0xFFF7FFFF;
-    REG_AESCNT |= 0x2970000;
-    REG_AESMAC[0] = buff[11];
-    REG_AESMAC[1] = buff[10];
-    REG_AESMAC[2] = buff[9];
-    REG_AESMAC[3] = buff[8];
-    REG_AESCNT |= 0x2800000;
-    REG_AESCTR[0] = buff[14];
-    REG_AESCTR[1] = buff[13];
-    REG_AESCTR[2] = buff[12];
-    REG_AESBLKCNT = 0x10000;
-
-    u32 v11 = ((REG_AESCNT | 0x80000000) & 0xC7FFFFFF); //Start and clear mode (ccm decrypt)
-    u32 v12 = v11 & 0xBFFFFFFF; //Disable Interrupt
-    REG_AESCNT = ((((v12 | 0x3000) & 0xFD7F3FFF) | (5 << 23)) & 0xFEBFFFFF) | (5 << 22);
-
-    //REG_AESCNT = 0x83D73C00;
-    REG_AESWRFIFO = buff[4];
-    REG_AESWRFIFO = buff[5];
-    REG_AESWRFIFO = buff[6];
-    REG_AESWRFIFO = buff[7];
-    while (((REG_AESCNT >> 5) & 0x1F) <= 3);
-    out[0] = REG_AESRDFIFO;
-    out[1] = REG_AESRDFIFO;
-    out[2] = REG_AESRDFIFO;
-    out[3] = REG_AESRDFIFO;
-    return ((REG_AESCNT >> 21) & 1);
+    // buff[4-7] is the encrypted block, buff[8-11] its MAC and buff[12-14]
+    // the nonce
+    int res = aes_ccm_decrypt(out, &buff[4], 1, &buff[12], &buff[8]);
+    return res == AES_ERR_TIMEOUT ? CTRCARD_ERR_TIMEOUT : res;
 }
 
-void Cart_Secure_Init(u32 *buf, u32 *out)
+int Cart_Secure_Init(u32 *buf, u32 *out)
 {
-    u8 mac_valid = card_aes(out, buf, 0x200);
+    int mac_valid = card_aes(out, buf);
+    if (mac_valid < 0)
+        return mac_valid;
 
 //    if (!mac_valid)
 //        ClearScreen(bottomScreen, RGB(255, 0, 0));
 
-    ioDelay(0xF0000);
-
-    CTR_SetSecKey(A0_Response);
-    CTR_SetSecSeed(out, true);
+    // Setting the key polls for the security engine to be ready, the
+    // fixed wait is only needed if it doesn't get there
+    if (CTR_SetSecKey(A0_Response) != CTRCARD_OK) {
+        timer_delay_us(CART_SECURE_DELAY_US);
+        if (CTR_SetSecKey(A0_Response) != CTRCARD_OK)
+            return CTRCARD_ERR_TIMEOUT;
+    }
+    if (CTR_SetSecSeed(out, true) != CTRCARD_OK)
+        return CTRCARD_ERR_TIMEOUT;
 
     rand1 = 0x42434445;//*((vu32*)0x10011000);
     rand2 = 0x46474849;//*((vu32*)0x10011010);
 
-    CTR_CmdSeed(rand1, rand2);
+    if (CTR_CmdSeed(rand1, rand2) == CTRCARD_ERR_TIMEOUT)
+        return CTRCARD_ERR_TIMEOUT;
 
     out[3] = BSWAP32(rand2);
     out[2] = BSWAP32(rand1);
-    CTR_SetSecSeed(out, false);
+    if (CTR_SetSecSeed(out, false) != CTRCARD_OK)
+        return CTRCARD_ERR_TIMEOUT;
 
     u32 test = 0;
     const u32 A2_cmd[4] = { 0xA2000000, 0x00000000, rand1, rand2 };
-    CTR_SendCommand(A2_cmd, 4, 1, 0x701002C, &test);
+    if (CTR_SendCommand(A2_cmd, 4, 1, 0x701002C, &test) == CTRCARD_ERR_TIMEOUT)
+        return CTRCARD_ERR_TIMEOUT;
 
     u32 test2 = 0;
     const u32 A3_cmd[4] = { 0xA3000000, 0x00000000, rand1, rand2 };
-    CTR_SendCommand(A3_cmd, 4, 1, 0x701002C, &test2);
+    if (CTR_SendCommand(A3_cmd, 4, 1, 0x701002C, &test2) == CTRCARD_ERR_TIMEOUT)
+        return CTRCARD_ERR_TIMEOUT;
     
     if(test==CartID && test2==A0_Response)
     {
@@ -212,10 +263,30 @@ void Cart_Secure_Init(u32 *buf, u32 *out)
         CTR_SendCommand(C5_cmd, 0, 1, 0x100002C, NULL);
     }
 
+    // Some carts answer the first commands after this with garbage, wait
+    // until the ID comes back right
     for (int i = 0; i < 5; ++i) {
-        CTR_SendCommand(A2_cmd, 4, 1, 0x701002C, &test);
-        ioDelay(0xF0000);
+        if (CTR_SendCommand(A2_cmd, 4, 1, 0x701002C, &test) == CTRCARD_ERR_TIMEOUT)
+            return CTRCARD_ERR_TIMEOUT;
+        if (test == CartID)
+            break;
+        timer_delay_us(CART_SECURE_DELAY_US);
+    }
+    return CTRCARD_OK;
+}
+
+bool Cart_CheckSync(void)
+{
+    // A cart that lost sync answers the ID command with garbage or not at
+    // all. Some carts send a stray encrypted response first (see
+    // Cart_Dummy), so give it a few tries.
+    const u32 A2_cmd[4] = { 0xA2000000, 0x00000000, rand1, rand2 };
+    for (int i = 0; i < 3; ++i) {
+        u32 id = 0;
+        if (CTR_SendCommand(A2_cmd, 4, 1, 0x701002C, &id) == CTRCARD_OK && id == CartID)
+            return true;
     }
+    return false;
 }
 
 void Cart_Dummy(void) {
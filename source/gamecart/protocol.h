@@ -8,6 +8,9 @@
 #define REG_CARDCONF  (*(vu16*)0x1000000C)
 #define REG_CARDCONF2 (*(vu8*)0x10000010)
 
+//REG_CARDCONF2
+#define CARD_EJECTED    (1u<<0) // Set while the slot is empty
+
 //REG_AUXSPICNT
 #define CARD_ENABLE     (1u<<15)
 #define CARD_SPI_ENABLE (1u<<13)
@@ -18,8 +21,11 @@
 
 u32 BSWAP32(u32 val);
 
-void Cart_Init(void);
+// These return 0, or a negative CTRCARD_* error from protocol_ctr.h
+int Cart_Init(void);
+int Cart_Secure_Init(u32* buf, u32* out);
+
 int Cart_IsInserted(void);
 u32 Cart_GetID(void);
-void Cart_Secure_Init(u32* buf, u32* out);
+bool Cart_CheckSync(void);
 void Cart_Dummy(void);
@@ -5,29 +5,41 @@
 #include "protocol_ctr.h"
 
 #include "protocol.h"
-#include "delay.h"
 #include "draw.h"
+#include "timer.h"
+
+static int CTR_WaitSecReady(void) {
+    struct Timeout timeout;
+    timeout_start(&timeout, CTRCARD_TIMEOUT_MS);
+    while (!(REG_CTRCARDSECCNT & 0x4000)) {
+        if (timeout_expired(&timeout))
+            return CTRCARD_ERR_TIMEOUT;
+    }
+    return CTRCARD_OK;
+}
 
-void CTR_SetSecKey(u32 value) {
+int CTR_SetSecKey(u32 value) {
     REG_CTRCARDSECCNT |= ((value & 3) << 8) | 4;
-    while (!(REG_CTRCARDSECCNT & 0x4000));
+    return CTR_WaitSecReady();
 }
 
-void CTR_SetSecSeed(const u32* seed, bool flag) {
+int CTR_SetSecSeed(const u32* seed, bool flag) {
     REG_CTRCARDSECSEED = BSWAP32(seed[3]);
     REG_CTRCARDSECSEED = BSWAP32(seed[2]);
     REG_CTRCARDSECSEED = BSWAP32(seed[1]);
     REG_CTRCARDSECSEED = BSWAP32(seed[0]);
     REG_CTRCARDSECCNT |= 0x8000;
 
-    while (!(REG_CTRCARDSECCNT & 0x4000));
+    if (CTR_WaitSecReady() != CTRCARD_OK)
+        return CTRCARD_ERR_TIMEOUT;
 
     if (flag) {
         (*(vu32*)0x1000400C) = 0x00000001; // Enable cart command encryption?
     }
+    return CTRCARD_OK;
 }
 
-void CTR_SendCommand(const u32 command[4], u32 pageSize, u32 blocks, u32 latency, void* buffer)
+int CTR_SendCommand(const u32 command[4], u32 pageSize, u32 blocks, u32 latency, void* buffer)
 {
 #ifdef VERBOSE_COMMANDS
     Debug("C> %08X %08X %08X %08X", command[0], command[1], command[2], command[3]);
@@ -81,6 +93,11 @@ void CTR_SendCommand(const u32 command[4], u32 pageSize, u32 blocks, u32 latency
     REG_CTRCARDBLKCNT = blocks - 1;
     transferLength *= blocks;
 
+    // Restarted every 4KiB, so a stalled cart is noticed just as quickly
+    // during a long transfer
+    struct Timeout timeout;
+    timeout_start(&timeout, CTRCARD_TIMEOUT_MS);
+
     // go
     REG_CTRCARDCNT = 0x10000000;
     REG_CTRCARDCNT = /*CTRKEY_PARAM | */CTRCARD_ACTIVATE | CTRCARD_nRESET | pageParam | latency;
@@ -90,6 +107,7 @@ void CTR_SendCommand(const u32 command[4], u32 pageSize, u32 blocks, u32 latency
     bool useBuf = ( NULL != pbuf );
     bool useBuf32 = (useBuf && (0 == (3 & ((u32)buffer))));
 
+    int result = CTRCARD_OK;
     u32 count = 0;
     u32 cardCtrl = REG_CTRCARDCNT;
 
@@ -102,6 +120,11 @@ void CTR_SendCommand(const u32 command[4], u32 pageSize, u32 blocks, u32 latency
                 u32 data = REG_CTRCARDFIFO;
                 *pbuf32++ = data;
                 count += 4;
+                if( !(count & 0xFFF) )
+                    timeout_start(&timeout, CTRCARD_TIMEOUT_MS);
+            } else if( timeout_expired(&timeout) ) {
+                result = CTRCARD_ERR_TIMEOUT;
+                break;
             }
         }
     }
@@ -118,6 +141,11 @@ void CTR_SendCommand(const u32 command[4], u32 pageSize, u32 blocks, u32 latency
                 pbuf[3] = (unsigned char) (data >> 24);
                 pbuf += sizeof (unsigned int);
                 count += 4;
+                if( !(count & 0xFFF) )
+                    timeout_start(&timeout, CTRCARD_TIMEOUT_MS);
+            } else if( timeout_expired(&timeout) ) {
+                result = CTRCARD_ERR_TIMEOUT;
+                break;
             }
         }
     }
@@ -130,26 +158,40 @@ void CTR_SendCommand(const u32 command[4], u32 pageSize, u32 blocks, u32 latency
                 u32 data = REG_CTRCARDFIFO;
                 (void)data;
                 count += 4;
+                if( !(count & 0xFFF) )
+                    timeout_start(&timeout, CTRCARD_TIMEOUT_MS);
+            } else if( timeout_expired(&timeout) ) {
+                result = CTRCARD_ERR_TIMEOUT;
+                break;
             }
         }
     }
 
     // if read is not finished, ds will not pull ROM CS to high, we pull it high manually
     if( count != transferLength ) {
+        if( result == CTRCARD_OK )
+            result = CTRCARD_ERR_SHORT;
         // MUST wait for next data ready,
         // if ds pull ROM CS to high during 4 byte data transfer, something will mess up
         // so we have to wait next data ready
-        do { cardCtrl = REG_CTRCARDCNT; } while(!(cardCtrl & CTRCARD_DATA_READY));
+        do { cardCtrl = REG_CTRCARDCNT; } while(!(cardCtrl & CTRCARD_DATA_READY) && !timeout_expired(&timeout));
         // and this tiny delay is necessary
-        ioDelay(33);
+        timer_delay_us(10);
         // pull ROM CS high
         REG_CTRCARDCNT = 0x10000000;
         REG_CTRCARDCNT = CTRKEY_PARAM | CTRCARD_ACTIVATE | CTRCARD_nRESET;
     }
     // wait rom cs high
-    do { cardCtrl = REG_CTRCARDCNT; } while( cardCtrl & CTRCARD_BUSY );
+    // (a pulled cart never does, give it one more timeout period)
+    timeout_start(&timeout, CTRCARD_TIMEOUT_MS);
+    do { cardCtrl = REG_CTRCARDCNT; } while( (cardCtrl & CTRCARD_BUSY) && !timeout_expired(&timeout) );
+    if( cardCtrl & CTRCARD_BUSY )
+        result = CTRCARD_ERR_TIMEOUT;
     //lastCmd[0] = command[0];lastCmd[1] = command[1];
 
+    if( (cardCtrl & CTRCARD_CRC_ERROR) && result == CTRCARD_OK )
+        result = CTRCARD_ERR_CRC;
+
 #ifdef VERBOSE_COMMANDS
     if (!useBuf) {
         Debug("C< NULL");
@@ -178,4 +220,6 @@ void CTR_SendCommand(const u32 command[4], u32 pageSize, u32 blocks, u32 latency
         }
     }
 #endif
+
+    return result;
 }
@@ -36,7 +36,16 @@
 
 #define CTRKEY_PARAM 0x1000000u
 
-void CTR_SetSecKey(u32 value);
-void CTR_SetSecSeed(const u32* seed, bool flag);
+// CTR_SendCommand() results
+#define CTRCARD_OK            0
+#define CTRCARD_ERR_CRC      -1     // The cart flagged a CRC error
+#define CTRCARD_ERR_SHORT    -2     // The transfer ended before all data arrived
+#define CTRCARD_ERR_TIMEOUT  -3     // The cart stopped responding (pulled?)
 
-void CTR_SendCommand(const u32 command[4], u32 pageSize, u32 blocks, u32 latency, void* buffer);
+// How long the cart may go without sending data before a command times out
+#define CTRCARD_TIMEOUT_MS   100u
+
+int CTR_SetSecKey(u32 value);
+int CTR_SetSecSeed(const u32* seed, bool flag);
+
+int CTR_SendCommand(const u32 command[4], u32 pageSize, u32 blocks, u32 latency, void* buffer);
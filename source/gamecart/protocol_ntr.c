@@ -4,8 +4,9 @@
 
 #include "protocol_ntr.h"
 #include "draw.h"
+#include "timer.h"
 
-void NTR_SendCommand(const u32 command[2], u32 pageSize, u32 latency, void* buffer)
+int NTR_SendCommand(const u32 command[2], u32 pageSize, u32 latency, void* buffer)
 {
 #ifdef VERBOSE_COMMANDS
     Debug("N> %08X %08X", command[0], command[1]);
@@ -48,6 +49,9 @@ void NTR_SendCommand(const u32 command[2], u32 pageSize, u32 latency, void* buff
 	    break; //Using 4K pagesize and transfer length by default
     }
 
+    struct Timeout timeout;
+    timeout_start(&timeout, NTRCARD_TIMEOUT_MS + pageSize / 1024);
+
     // go
     REG_NTRCARDROMCNT = 0x10000000;
     REG_NTRCARDROMCNT = NTRKEY_PARAM | NTRCARD_ACTIVATE | NTRCARD_nRESET | pageParam | latency;
@@ -57,6 +61,7 @@ void NTR_SendCommand(const u32 command[2], u32 pageSize, u32 latency, void* buff
     bool useBuf = ( NULL != pbuf );
     bool useBuf32 = (useBuf && (0 == (3 & ((u32)buffer))));
 
+    int result = NTRCARD_OK;
     u32 count = 0;
     u32 cardCtrl = REG_NTRCARDROMCNT;
 
@@ -69,6 +74,9 @@ void NTR_SendCommand(const u32 command[2], u32 pageSize, u32 latency, void* buff
                 u32 data = REG_NTRCARDFIFO;
                 *pbuf32++ = data;
                 count += 4;
+            } else if( timeout_expired(&timeout) ) {
+                result = NTRCARD_ERR_TIMEOUT;
+                break;
             }
         }
     }
@@ -85,6 +93,9 @@ void NTR_SendCommand(const u32 command[2], u32 pageSize, u32 latency, void* buff
                 pbuf[3] = (unsigned char) (data >> 24);
                 pbuf += sizeof (unsigned int);
                 count += 4;
+            } else if( timeout_expired(&timeout) ) {
+                result = NTRCARD_ERR_TIMEOUT;
+                break;
             }
         }
     }
@@ -97,6 +108,9 @@ void NTR_SendCommand(const u32 command[2], u32 pageSize, u32 latency, void* buff
                 u32 data = REG_NTRCARDFIFO;
                 (void)data;
                 count += 4;
+            } else if( timeout_expired(&timeout) ) {
+                result = NTRCARD_ERR_TIMEOUT;
+                break;
             }
         }
     }
@@ -106,7 +120,7 @@ void NTR_SendCommand(const u32 command[2], u32 pageSize, u32 latency, void* buff
         // MUST wait for next data ready,
         // if ds pull ROM CS to high during 4 byte data transfer, something will mess up
         // so we have to wait next data ready
-        do { cardCtrl = REG_NTRCARDROMCNT; } while(!(cardCtrl & NTRCARD_DATA_READY));
+        do { cardCtrl = REG_NTRCARDROMCNT; } while(!(cardCtrl & NTRCARD_DATA_READY) && !timeout_expired(&timeout));
         // and this tiny delay is necessary
         //ioAK2Delay(33);
         // pull ROM CS high
@@ -114,7 +128,11 @@ void NTR_SendCommand(const u32 command[2], u32 pageSize, u32 latency, void* buff
         REG_NTRCARDROMCNT = NTRKEY_PARAM | NTRCARD_ACTIVATE | NTRCARD_nRESET/* | 0 | 0x0000*/;
     }
     // wait rom cs high
-    do { cardCtrl = REG_NTRCARDROMCNT; } while( cardCtrl & NTRCARD_BUSY );
+    // (a pulled cart never does, give it one more timeout period)
+    timeout_start(&timeout, NTRCARD_TIMEOUT_MS);
+    do { cardCtrl = REG_NTRCARDROMCNT; } while( (cardCtrl & NTRCARD_BUSY) && !timeout_expired(&timeout) );
+    if( cardCtrl & NTRCARD_BUSY )
+        result = NTRCARD_ERR_TIMEOUT;
     //lastCmd[0] = command[0];lastCmd[1] = command[1];
 
 #ifdef VERBOSE_COMMANDS
@@ -145,4 +163,6 @@ void NTR_SendCommand(const u32 command[2], u32 pageSize, u32 latency, void* buff
         }
     }
 #endif
+
+    return result;
 }
@@ -61,4 +61,11 @@
 
 #define NTRKEY_PARAM 0x3F1FFFu
 
-void NTR_SendCommand(const u32 command[2], u32 pageSize, u32 latency, void* buffer);
+// NTR_SendCommand() results
+#define NTRCARD_OK            0
+#define NTRCARD_ERR_TIMEOUT  -3     // The cart stopped responding (pulled?)
+
+// How long a command may take before it times out, plus 1ms per KiB of data
+#define NTRCARD_TIMEOUT_MS   100u
+
+int NTR_SendCommand(const u32 command[2], u32 pageSize, u32 latency, void* buffer);
@@ -0,0 +1,104 @@
+#include "gooddb.h"
+#include "arena.h"
+#include "draw.h"
+
+#define GOODDB_MAGIC   0x42444355u // "UCDB"
+#define GOODDB_VERSION 1u
+
+struct GoodDbHeader {
+    u32 magic;
+    u32 version;
+    u32 count;
+    u32 reserved;
+};
+
+struct GoodDbEntry {
+    char product_code[16];
+    u64 size;
+    u32 crc32;
+    u8 sha1[SHA_1_HASH_SIZE];
+};
+
+_Static_assert(sizeof(struct GoodDbEntry) == 0x30, "Index entries are 0x30 bytes");
+
+static const struct GoodDbEntry* entries = NULL;
+static u32 entry_count = 0;
+
+static int compare_key(const struct GoodDbEntry* entry, const char* product_code, u64 size) {
+    int res = memcmp(entry->product_code, product_code, sizeof(entry->product_code));
+    if (res != 0)
+        return res;
+    return entry->size < size ? -1 : entry->size > size;
+}
+
+bool gooddb_load(const char* path) {
+    struct GoodDbHeader header;
+    FIL fp;
+    UINT bytes_read = 0;
+
+    entries = NULL;
+    entry_count = 0;
+    if (f_open(&fp, path, FA_READ) != FR_OK)
+        return false;
+
+    bool ok = false;
+    if (f_read(&fp, &header, sizeof(header), &bytes_read) != FR_OK || bytes_read != sizeof(header) ||
+        header.magic != GOODDB_MAGIC || header.version != GOODDB_VERSION ||
+        header.count > GOODDB_MAX_SIZE / sizeof(struct GoodDbEntry) ||
+        f_size(&fp) != sizeof(header) + header.count * sizeof(struct GoodDbEntry)) {
+        Debug("\"%s\" is not a valid index.", path);
+        goto done;
+    }
+
+    const UINT size = header.count * sizeof(struct GoodDbEntry);
+    struct GoodDbEntry* table = arena_alloc(size);
+    if (table == NULL) {
+        Debug("Out of memory for \"%s\"", path);
+        goto done;
+    }
+    if (f_read(&fp, table, size, &bytes_read) != FR_OK || bytes_read != size) {
+        Debug("Failed to read \"%s\"", path);
+        goto done;
+    }
+
+    // The search only works on a sorted table
+    for (u32 i = 1; i < header.count; ++i) {
+        if (compare_key(&table[i - 1], table[i].product_code, table[i].size) > 0) {
+            Debug("\"%s\" is not sorted.", path);
+            goto done;
+        }
+    }
+
+    entries = table;
+    entry_count = header.count;
+    ok = true;
+
+done:
+    f_close(&fp);
+    return ok;
+}
+
+enum GoodDbResult gooddb_check(const char* product_code, const struct MultiHash* hash) {
+    char key[16] = { 0 };
+    u32 low = 0, high = entry_count;
+
+    // Product codes in the header are padded with zeros, but may not be
+    strncpy(key, product_code, sizeof(key));
+
+    // First entry not below the key
+    while (low < high) {
+        const u32 mid = low + (high - low) / 2;
+        if (compare_key(&entries[mid], key, hash->size) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    enum GoodDbResult res = GOODDB_UNKNOWN;
+    for (u32 i = low; i < entry_count && compare_key(&entries[i], key, hash->size) == 0; ++i) {
+        if (entries[i].crc32 == hash->crc32 && !memcmp(entries[i].sha1, hash->sha1_hash, SHA_1_HASH_SIZE))
+            return GOODDB_MATCH;
+        res = GOODDB_MISMATCH;
+    }
+    return res;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "common.h"
+#include "multihash.h"
+
+// Index of known good dumps, checked against when a dump is done. The
+// file is read into the arena as is and searched in place.
+//
+// Format, all little endian:
+//   0x00  "UCDB"
+//   0x04  u32 version, 1
+//   0x08  u32 number of entries
+//   0x0C  u32 reserved
+//   0x10  entries of 0x30 bytes, sorted by product code, then size:
+//         0x00  product code, as in the NCCH header, padded with zeros
+//         0x10  u64 image size in bytes
+//         0x18  u32 CRC32
+//         0x1C  SHA-1
+// A title with several revisions has an entry for each.
+#define GOODDB_PATH "/uncart.db"
+
+// Largest index that's loaded, about 40000 titles
+#define GOODDB_MAX_SIZE (2u * 1024 * 1024)
+
+enum GoodDbResult {
+    GOODDB_UNKNOWN,  // Not in the index, or no index
+    GOODDB_MATCH,    // Same as a known good dump
+    GOODDB_MISMATCH, // Known title and size, but the hashes differ
+};
+
+// Loads the index from the SD card into the arena. Returns false if there
+// is none or it's broken, lookups then find nothing.
+bool gooddb_load(const char* path);
+
+enum GoodDbResult gooddb_check(const char* product_code, const struct MultiHash* hash);
@@ -1,11 +1,38 @@
 #include "hid.h"
+#include "timer.h"
+
+// Buttons held at the last look, shared so a press InputWait() returned
+// isn't reported again by InputPoll()
+static u32 pad_state_old = 0;
+static u32 pressed_latch = 0;
+static u32 last_sample = 0;
 
 u32 InputWait(void) {
-    u32 pad_state_old = ~HID_STATE;
+    pressed_latch = 0;
+    pad_state_old = ~HID_STATE;
     while (true) {
         u32 pad_state = ~HID_STATE;
-        if ((pad_state ^ pad_state_old) & pad_state)
-            return pad_state;
+        bool pressed = (pad_state ^ pad_state_old) & pad_state;
         pad_state_old = pad_state;
+        if (pressed)
+            return pad_state;
     }
 }
+
+void InputSample(void) {
+    const u32 now = timer_ticks();
+    if (now - last_sample < TIMER_TICKS_MS(HID_POLL_MS))
+        return;
+    last_sample = now;
+
+    u32 pad_state = ~HID_STATE;
+    pressed_latch |= (pad_state ^ pad_state_old) & pad_state;
+    pad_state_old = pad_state;
+}
+
+u32 InputPoll(void) {
+    InputSample();
+    u32 pressed = pressed_latch;
+    pressed_latch = 0;
+    return pressed;
+}
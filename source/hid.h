@@ -17,4 +17,15 @@
 #define BUTTON_X      (1 << 10)
 #define BUTTON_Y      (1 << 11)
 
+// Buttons are looked at no more often than this, so a press isn't seen
+// twice while it bounces
+#define HID_POLL_MS 16u
+
 u32 InputWait(void);
+
+// Non-blocking input. InputSample() looks at the buttons and remembers
+// the ones that went down, it's cheap enough to call from long loops and
+// costs only a timer read when called more often than HID_POLL_MS.
+// InputPoll() samples too and returns and forgets what was remembered.
+void InputSample(void);
+u32 InputPoll(void);
@@ -1,5 +1,9 @@
 #include "i2c.h"
 #include "draw.h"
+#include "timer.h"
+
+// A transfer on the bus takes microseconds, this only catches a hung bus
+#define I2C_TIMEOUT_MS 10u
 
 //-----------------------------------------------------------------------------
 
@@ -45,12 +49,20 @@ inline vu8* i2cGetCntReg(u8 bus_id) {
 
 //-----------------------------------------------------------------------------
 
-inline void i2cWaitBusy(u8 bus_id) {
-    while (*i2cGetCntReg(bus_id) & 0x80);
+// Returns false if the bus is still busy after the timeout
+inline bool i2cWaitBusy(u8 bus_id) {
+    struct Timeout timeout;
+    timeout_start(&timeout, I2C_TIMEOUT_MS);
+    while (*i2cGetCntReg(bus_id) & 0x80) {
+        if (timeout_expired(&timeout))
+            return false;
+    }
+    return true;
 }
 
 inline bool i2cGetResult(u8 bus_id) {
-    i2cWaitBusy(bus_id);
+    if (!i2cWaitBusy(bus_id))
+        return false;
     return (*i2cGetCntReg(bus_id) >> 4) & 1;
 }
 
@@ -115,16 +127,20 @@ bool i2cReadRegisterBuffer(unsigned int dev_id, int reg, u8* buffer, size_t buf_
 
     if (buf_size != 1) {
         for (size_t i = 0; i < buf_size - 1; i++) {
-            i2cWaitBusy(bus_id);
+            if (!i2cWaitBusy(bus_id))
+                return false;
             *i2cGetCntReg(bus_id) = 0xF0;
-            i2cWaitBusy(bus_id);
+            if (!i2cWaitBusy(bus_id))
+                return false;
             buffer[i] = *i2cGetDataReg(bus_id);
         }
     }
 
-    i2cWaitBusy(bus_id);
+    if (!i2cWaitBusy(bus_id))
+        return false;
     *i2cGetCntReg(bus_id) = 0xE1;
-    i2cWaitBusy(bus_id);
+    if (!i2cWaitBusy(bus_id))
+        return false;
     *buffer = *i2cGetDataReg(bus_id);
     return true;
 }
@@ -1,10 +1,22 @@
+#include "aes.h"
+#include "arena.h"
+#include "cartdev.h"
+#include "catalog.h"
+#include "cia.h"
 #include "draw.h"
+#include "dump.h"
+#include "extract.h"
 #include "hid.h"
 #include "fatfs/ff.h"
+#include "gooddb.h"
 #include "gamecart/protocol.h"
 #include "gamecart/command_ctr.h"
 #include "headers.h"
 #include "i2c.h"
+#include "sha.h"
+#include "sigcheck.h"
+#include "telemetry.h"
+#include "timer.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -21,84 +33,501 @@ static void poweroff()
 static FATFS fs;
 static FIL file;
 
+// Name index of the output directory, so creating files stays fast with
+// thousands of dumps in it. Two slots per file with a long name. Allocated
+// once, FatFs keeps it up to date for as long as the volume stays mounted.
+#define DIR_INDEX_SLOTS 0x8000u
+static DWORD* dir_index;
+
+// Initial size of the cluster link map of an output file, in DWORDs. Enough
+// for a few dozen fragments, it's grown from the arena when the part is more
+// fragmented than that.
+#define CLMT_INITIAL_SIZE 64u
+
+struct Options {
+    bool title_dirs;
+    bool verify_writes;
+    bool dual_read;
+    bool decrypt;
+    bool cia;
+    bool split_partitions;
+    bool skip_update;
+    bool extract;
+    bool catalog;
+    bool batch;
+};
+
+static struct Options options;
+
+static const struct {
+    const char* name;
+    bool* value;
+} option_list[] = {
+    { "Per-title folders", &options.title_dirs },
+    { "Verify SD writes", &options.verify_writes },
+    { "Read everything twice", &options.dual_read },
+    { "Decrypt partitions", &options.decrypt },
+    { "Dump as CIA", &options.cia },
+    { "One file per partition", &options.split_partitions },
+    { "Skip update data", &options.skip_update },
+    { "Extract files, no dump", &options.extract },
+    { "Catalog only, no dump", &options.catalog },
+    { "Batch, every cart in turn", &options.batch },
+};
+
 static void ClearTop(void) {
     ClearScreen(TOP_SCREEN1, RGB(255, 255, 255));
     current_y = 0;
 }
 
+// Batch mode: the options are set once, then every cart that goes in is
+// handled without questions and the SD card stays mounted in between.
+static bool batch_running = false;
+static bool sd_mounted = false;
+
+// Polling interval of the cart slot, and how long a newly inserted cart
+// has to stay put before it's used, so contacts that bounce as it slides
+// in don't start the init
+#define CART_POLL_MS   10u
+#define CART_SETTLE_MS 250u
+
+static FRESULT sd_mount(void) {
+    if (sd_mounted)
+        return FR_OK;
+    FRESULT res = f_mount(&fs, "0:", 0);
+    sd_mounted = res == FR_OK;
+    return res;
+}
+
+static void sd_unmount(void) {
+    if (batch_running || !sd_mounted)
+        return;
+    f_mount(NULL, "0:", 0);
+    sd_mounted = false;
+}
+
+static void stop_batch(void) {
+    batch_running = false;
+    sd_unmount();
+}
+
+// Waits for a cart to be inserted or removed. Returns false if B was
+// pressed to stop batch mode instead.
+static bool wait_cart(bool inserted) {
+    u32 stable_ms = 0;
+
+    // Forget presses from before, B may have just cancelled a dump
+    InputPoll();
+    while (stable_ms < (inserted ? CART_SETTLE_MS : CART_POLL_MS)) {
+        if (InputPoll() & BUTTON_B)
+            return false;
+        stable_ms = (bool)Cart_IsInserted() == inserted ? stable_ms + CART_POLL_MS : 0;
+        timer_delay_ms(CART_POLL_MS);
+    }
+    // Nothing cached is from the cart that comes next
+    if (!inserted)
+        cartdev_invalidate();
+    return true;
+}
+
 static void wait_key(void) {
+    if (batch_running)
+        return;
     Debug("Press key to continue...");
     InputWait();
 }
 
-struct Context {
-    u8* buffer;
-    size_t buffer_size;
+// After a problem with the cart. Batch mode never goes on, it moves to the
+// next cart.
+static bool ask_continue(void) {
+    if (batch_running)
+        return false;
+    Debug("Press A to continue anyway.");
+    return InputWait() & BUTTON_A;
+}
 
-    u32 cart_size;
-    u32 media_unit;
-};
+// Returns false if the user cancelled
+static bool wait_sd_swap(void) {
+    if (batch_running)
+        return true;
+    Debug("Change the SD card now and/or press a key.");
+    Debug("(Or SELECT to cancel)");
+    return !(InputWait() & BUTTON_SELECT);
+}
+
+static void options_menu(void) {
+    const size_t count = sizeof(option_list) / sizeof(option_list[0]);
+    size_t cursor = 0;
+
+    while (true) {
+        ClearTop();
+        Debug("Uncart: ROM dump tool v0.2");
+        Debug("Insert your game cart now.");
+        DebugBlank();
+        for (size_t i = 0; i < count; ++i) {
+            Debug("%c %-24s [%s]", i == cursor ? '>' : ' ', option_list[i].name,
+                  *option_list[i].value ? "on" : "off");
+        }
+        DebugBlank();
+        Debug("UP/DOWN/A: change options, START: dump");
 
-static int dump_cart_region(u32 start_sector, u32 end_sector, FIL* output_file, struct Context* ctx) {
-    u32 read_size = 1u * 1024 * 1024 / ctx->media_unit; // 1MiB default
-
-    // Dump remaining data
-    u32 current_sector = start_sector;
-    while (current_sector < end_sector) {
-        unsigned int percentage = current_sector * 100 / ctx->cart_size;
-        Debug("Dumping %08X / %08X - %3u%%", current_sector, ctx->cart_size, percentage);
-
-        u8* read_ptr = ctx->buffer;
-        while (read_ptr < ctx->buffer + ctx->buffer_size && current_sector < end_sector) {
-            Cart_Dummy();
-            Cart_Dummy();
-            
-	    //If there is less data to read than the curren read_size, fix it
-	    if (end_sector - current_sector < read_size)
-            {
-                read_size = end_sector - current_sector;
+        u32 key = InputWait();
+        if (key & BUTTON_START)
+            break;
+        if ((key & BUTTON_UP) && cursor > 0)
+            cursor--;
+        if ((key & BUTTON_DOWN) && cursor + 1 < count)
+            cursor++;
+        if (key & BUTTON_A)
+            *option_list[cursor].value = !*option_list[cursor].value;
+    }
+}
+
+// Allocates the whole part up front and builds a cluster link map for it,
+// so seeking anywhere in the file never has to walk the FAT again.
+// The link map is allocated from the arena and must be released by the
+// caller after closing the file.
+static FRESULT prepare_output_file(FIL* fp, DWORD size) {
+    FRESULT res = f_lseek(fp, size);
+    if (res != FR_OK)
+        return res;
+    if (f_tell(fp) != size) {
+        // Clipped because the SD card is full
+        f_lseek(fp, 0);
+        f_truncate(fp);
+        return FR_DENIED;
+    }
+
+    size_t mark = arena_mark();
+    DWORD* tbl = arena_alloc(CLMT_INITIAL_SIZE * sizeof(DWORD));
+    if (tbl != NULL) {
+        tbl[0] = CLMT_INITIAL_SIZE;
+        fp->cltbl = tbl;
+        res = f_lseek(fp, CREATE_LINKMAP);
+        if (res == FR_NOT_ENOUGH_CORE) {
+            // tbl[0] now holds the required size
+            DWORD required = tbl[0];
+            arena_release(mark);
+            tbl = arena_alloc(required * sizeof(DWORD));
+            fp->cltbl = tbl;
+            if (tbl != NULL) {
+                tbl[0] = required;
+                res = f_lseek(fp, CREATE_LINKMAP);
             }
-            CTR_CmdReadData(current_sector, ctx->media_unit, read_size, read_ptr);
-            read_ptr += ctx->media_unit * read_size;
-            current_sector += read_size;
         }
+    }
+    if (tbl == NULL || res != FR_OK) {
+        fp->cltbl = NULL;
+        Debug("No cluster link map, seeking will be slow.");
+    }
 
-        u8* write_ptr = ctx->buffer;
-        while (write_ptr < read_ptr) {
-            unsigned int bytes_written = 0;
-            f_write(output_file, write_ptr, (size_t)(read_ptr - write_ptr), &bytes_written);
-            Debug("Wrote 0x%x bytes...", bytes_written);
+    return f_lseek(fp, 0);
+}
 
-            if (bytes_written == 0) {
-                Debug("Writing failed! :( SD full?");
-                return -1;
+static FRESULT write_error_map(const char* path, const char* title) {
+    char title_buf[17];
+    FIL map_file;
+
+    snprintf(title_buf, sizeof(title_buf), "%.16s", title);
+    FRESULT res = f_open(&map_file, path, FA_WRITE | FA_CREATE_ALWAYS);
+    if (res != FR_OK)
+        return res;
+    if (dump_map_write(&map_file, title_buf) < 0)
+        res = FR_DISK_ERR;
+    FRESULT close_res = f_close(&map_file);
+    return res != FR_OK ? res : close_res;
+}
+
+// Adds the cart to the catalog on the SD card, which stays in place.
+static void catalog_cart(const NCSD_HEADER* ncsd, const NCCH_HEADER* ncch, u32 media_unit) {
+    if (sd_mount() != FR_OK) {
+        Debug("Failed to f_mount...");
+        return;
+    }
+    if (catalog_append(CATALOG_PATH, ncsd, ncch, Cart_GetID(), media_unit) == 0)
+        Debug("Added %.16s to \"%s\"", ncch->product_code, CATALOG_PATH);
+    else
+        Debug("Failed to write \"%s\"", CATALOG_PATH);
+    sd_unmount();
+}
+
+// Checks the signatures of the NCSD header and the game partition's NCCH
+// header. Returns false if one of them is bad and the user doesn't want
+// to go on.
+static bool check_signatures(const NCSD_HEADER* ncsd, const NCCH_HEADER* ncch, u32 media_unit) {
+    u8* exheader = arena_alloc(0x800);
+    enum SigResult ncsd_res, ncch_res;
+
+    if (exheader == NULL || sd_mount() != FR_OK)
+        return true;
+    ncsd_res = sig_check_ncsd(ncsd);
+    if (ncch_read_exheader(ncch, (u64)ncsd->offsetsize_table[0].offset * media_unit, exheader) == 0)
+        ncch_res = sig_check_ncch(ncch, exheader);
+    else
+        ncch_res = SIG_ERROR;
+    sd_unmount();
+
+    Debug("NCSD signature: %s", sig_result_name(ncsd_res));
+    Debug("NCCH signature: %s", sig_result_name(ncch_res));
+    if (ncsd_res != SIG_BAD && ncch_res != SIG_BAD)
+        return true;
+
+    Debug("Bad cart, or the headers were misread!");
+    return ask_continue();
+}
+
+// Writes the finished hashes of a whole cart image. The image is named
+// .3ds, whether or not it was split into parts.
+static FRESULT write_manifest(const char* path, const char* title, const struct MultiHash* hashes) {
+    char name[24];
+    FIL manifest;
+
+    snprintf(name, sizeof(name), "%.16s.3ds", title);
+    FRESULT res = f_open(&manifest, path, FA_WRITE | FA_CREATE_ALWAYS);
+    if (res != FR_OK)
+        return res;
+    res = multihash_write_header(&manifest, title);
+    if (res == FR_OK)
+        res = multihash_write_line(&manifest, hashes, name);
+    FRESULT close_res = f_close(&manifest);
+    return res != FR_OK ? res : close_res;
+}
+
+// Looks the finished dump up in the index of known good dumps, if there
+// is one on the SD card.
+static void check_known_good(const char* product_code, const struct MultiHash* hashes) {
+    if (!gooddb_load(GOODDB_PATH))
+        return;
+
+    switch (gooddb_check(product_code, hashes)) {
+        case GOODDB_MATCH:
+            Debug("Matches a known good dump.");
+            break;
+        case GOODDB_MISMATCH:
+            Debug("DOESN'T match the known good dump!");
+            Debug("Clean the cart contacts and dump again.");
+            break;
+        default:
+            Debug("Not in the known good index.");
+            break;
+    }
+}
+
+// Update data for old and New 3DS
+#define UPDATE_PARTITIONS ((1u << 6) | (1u << 7))
+
+// Lets the user pick the partitions to dump, returns them as a bit mask.
+static u32 select_partitions(const NCSD_HEADER* ncsd, u32 media_unit, u32 selected) {
+    u32 present = 0;
+    for (u32 i = 0; i < 8; ++i) {
+        if (ncsd->offsetsize_table[i].size != 0)
+            present |= 1u << i;
+    }
+    selected &= present;
+    if (present == 0)
+        return 0;
+
+    u32 cursor = 0;
+    while (!(present & (1u << cursor)))
+        cursor++;
+
+    while (true) {
+        ClearTop();
+        Debug("Partitions to dump:");
+        DebugBlank();
+        for (u32 i = 0; i < 8; ++i) {
+            if (!(present & (1u << i)))
+                continue;
+            u64 id;
+            memcpy(&id, ncsd->partition_id_table[i], sizeof(id));
+            Debug("%c [%c] %lu %016llX %5lu MB", i == cursor ? '>' : ' ', (selected & (1u << i)) ? 'x' : ' ',
+                  (unsigned long)i, id,
+                  (unsigned long)((u64)ncsd->offsetsize_table[i].size * media_unit / 1024 / 1024));
+        }
+        DebugBlank();
+        Debug("UP/DOWN/A: select, START: dump");
+
+        u32 key = InputWait();
+        if (key & BUTTON_START)
+            return selected;
+        if (key & BUTTON_UP) {
+            for (u32 i = cursor; i-- > 0;) {
+                if (present & (1u << i)) {
+                    cursor = i;
+                    break;
+                }
+            }
+        }
+        if (key & BUTTON_DOWN) {
+            for (u32 i = cursor + 1; i < 8; ++i) {
+                if (present & (1u << i)) {
+                    cursor = i;
+                    break;
+                }
             }
+        }
+        if (key & BUTTON_A)
+            selected ^= 1u << cursor;
+    }
+}
+
+// Dumps each selected partition to its own file, named by partition ID.
+// Partitions are in cart order, so this is one pass over the cart that
+// skips what isn't selected. With ctx->hashes set, the hashes of each file
+// go into the manifest.
+static int dump_partitions(const NCSD_HEADER* ncsd, u32 selected, const char* dir, const char* title,
+                           struct Context* ctx) {
+    char filename[64];
+    FIL manifest;
+    bool manifest_open = false;
+    int res = 0;
+
+    if (ctx->hashes != NULL) {
+        snprintf(filename, sizeof(filename), "%s/%.16s.hashes", dir, title);
+        manifest_open = f_open(&manifest, filename, FA_WRITE | FA_CREATE_ALWAYS) == FR_OK &&
+            multihash_write_header(&manifest, title) == FR_OK;
+        if (!manifest_open)
+            Debug("Failed to create \"%s\"", filename);
+    }
 
-            write_ptr += bytes_written;
+    for (u32 i = 0; i < 8 && res == 0; ++i) {
+        if (!(selected & (1u << i)))
+            continue;
+
+        const partition_offsetsize* partition = &ncsd->offsetsize_table[i];
+        const u64 size = (u64)partition->size * ctx->media_unit;
+        const size_t name_offset = strlen(dir) + 1;
+        u64 id;
+        memcpy(&id, ncsd->partition_id_table[i], sizeof(id));
+        snprintf(filename, sizeof(filename), "%s/%016llX.%s", dir, id, i == 0 ? "cxi" : "cfa");
+        Debug("Partition %lu to \"%s\"", (unsigned long)i, filename);
+        if (size > 0xFFFFFFFFu) {
+            Debug("Too big for FAT32, skipped.");
+            continue;
         }
+
+        size_t mark = arena_mark();
+        if (f_open(&file, filename, FA_READ | FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+            Debug("Failed to create file.");
+            res = -1;
+            break;
+        }
+
+        res = -1;
+        FRESULT prep_res = prepare_output_file(&file, (DWORD)size);
+        if (prep_res == FR_DENIED) {
+            Debug("Not enough space on the SD card!");
+        } else if (prep_res != FR_OK) {
+            Debug("Failed to allocate file.");
+        } else if (ctx->hashes == NULL || multihash_start(ctx->hashes) == SHA_OK) {
+            u64 start = timer_timestamp();
+            res = dump_cart_region(partition->offset, partition->offset + partition->size, &file, ctx);
+            if (res == 0 && ctx->hashes != NULL && multihash_finish(ctx->hashes) == SHA_OK) {
+                multihash_report(ctx->hashes, timer_elapsed_us(start));
+                if (manifest_open && multihash_write_line(&manifest, ctx->hashes, filename + name_offset) != FR_OK)
+                    Debug("Failed to write the hashes.");
+            }
+        }
+
+        if (res < 0)
+            f_truncate(&file);
+        f_close(&file);
+        arena_release(mark);
     }
 
-    return 0;
+    if (manifest_open)
+        f_close(&manifest);
+    return res;
+}
+
+// Extracts the files of the game partition to /<product code>/extracted
+// instead of dumping the cart.
+static void extract_game(const struct NcchCrypto* crypto, u64 base, const char* product, u8* buffer,
+                         u32 buffer_size) {
+    char dir[48];
+
+    if (!(crypto->readable & 1)) {
+        Debug("The game partition can't be decrypted!");
+        return;
+    }
+
+    snprintf(dir, sizeof(dir), "/%.16s", product);
+    Debug("Extracting to \"%s/extracted\"", dir);
+    if (!wait_sd_swap())
+        return;
+
+    if (sd_mount() != FR_OK) {
+        Debug("Failed to f_mount...");
+        return;
+    }
+    FRESULT res = f_mkdir(dir);
+    if (res != FR_OK && res != FR_EXIST) {
+        Debug("Failed to create directory...");
+    } else {
+        strcat(dir, "/extracted");
+        if (extract_partition(crypto, base, dir, buffer, buffer_size) == 0)
+            Debug("Done!");
+    }
+    sd_unmount();
+}
+
+// Dumps each content to its place in the CIA, hashing it on the way, and
+// writes the headers once all hashes are known.
+static int dump_cia_contents(struct CiaBuilder* cia, FIL* fp, struct Context* ctx) {
+    int res = 0;
+
+    ctx->hash_output = true;
+    for (u32 i = 0; i < cia->content_count && res == 0; ++i) {
+        struct CiaContent* content = &cia->contents[i];
+        if (f_lseek(fp, content->offset) != FR_OK || sha_init(SHA_MODE_256) != SHA_OK) {
+            res = -1;
+            break;
+        }
+        res = dump_cart_region(content->start_sector, content->end_sector, fp, ctx);
+        if (res == 0 && sha_get(content->hash, SHA_MODE_256) != SHA_OK)
+            res = -1;
+    }
+    ctx->hash_output = false;
+
+    if (res == 0 && cia_write_headers(cia, fp, ctx->buffer) != FR_OK) {
+        Debug("Failed to write the CIA header.");
+        res = -1;
+    }
+    return res;
 }
 
 int main() {
 
+    timer_init();
+    aes_init();
+
+    dir_index = arena_alloc(DIR_INDEX_SLOTS * sizeof(DWORD));
+    const size_t program_mark = arena_mark();
+
 restart_program:
     // Setup boring stuff - clear the screen, initialize SD output, etc...
-    ClearTop();
-    
-    Debug("Uncart: ROM dump tool v0.2");
-    Debug("Insert your game cart now.");
-    wait_key();
+    if (!batch_running) {
+        options_menu();
+        batch_running = options.batch;
+    }
+    if (batch_running) {
+        Debug("Batch mode: insert a cart, B to stop.");
+        if (!wait_cart(true)) {
+            stop_batch();
+            goto restart_program;
+        }
+        ClearTop();
+    }
+
+    cartdev_close();
+    arena_release(program_mark);
 
-    // Arbitrary target buffer
-    // TODO: This should be done in a nicer way ;)
-    u32* target = (u32*)0x22000000;
-    NCSD_HEADER *ncsdHeader = (NCSD_HEADER*)target;
     u32 target_buf_size = 16u * 1024u * 1024u; // 16MB
+    u32* target = arena_alloc(target_buf_size);
+    NCSD_HEADER *ncsdHeader = (NCSD_HEADER*)target;
     memset(target, 0, target_buf_size); // Clear our buffer
-    
-    u32* ncchHeaderData = (u32*)0x23000000;
+
+    u32* ncchHeaderData = arena_alloc(0x4000);
     NCCH_HEADER *ncchHeader = (NCCH_HEADER*)ncchHeaderData;
 
     *(vu32*)0x10000020 = 0; // InitFS stuff
@@ -106,34 +535,42 @@ restart_program:
 
     // ROM DUMPING CODE STARTS HERE
 
-    Cart_Init();
-    Debug("Cart id is %08x", Cart_GetID());
+    u64 init_start = timer_timestamp();
+    if (Cart_Init() != 0) {
+        Debug("Cart is not responding!");
+        goto restart_prompt;
+    }
+    Debug("Cart id is %08lx", (unsigned long)Cart_GetID());
     Debug("Reading NCCH header...");
-    CTR_CmdReadHeader(ncchHeader);
+    if (CTR_CmdReadHeader(ncchHeader) != 0)
+        Debug("Cart reported an error reading the header.");
     Debug("Done reading NCCH header.");
 
     if (strncmp((const char*)(ncchHeader->magic), "NCCH", 4))
     {
         Debug("NCCH magic not found in header!!!");
-        Debug("Press A to continue anyway.");
-        if (!(InputWait() & BUTTON_A))
+        if (!ask_continue())
             goto restart_prompt;
     }
 
     u32 sec_keys[4];
-    Cart_Secure_Init(ncchHeaderData, sec_keys);
+    if (Cart_Secure_Init(ncchHeaderData, sec_keys) != 0) {
+        Debug("Cart is not responding!");
+        goto restart_prompt;
+    }
 
     // Guess 0x200 first for the media size. this will be set correctly once the cart header is read 
     // Read out the header 0x0000-0x1000
     Cart_Dummy();
     Debug("Reading NCSD header...");
-    CTR_CmdReadData(0, 0x200, 0x1000 / 0x200, target);
+    if (CTR_CmdReadData(0, 0x200, 0x1000 / 0x200, target) != 0)
+        Debug("Cart reported an error reading the header.");
     Debug("Done reading NCSD header.");
+    Debug("Cart ready after %lu ms", (unsigned long)(timer_elapsed_us(init_start) / 1000));
     
     if (strncmp((const char*)(ncsdHeader->magic), "NCSD", 4)) {
         Debug("NCSD magic not found in header!!!");
-        Debug("Press A to continue anyway.");
-        if (!(InputWait() & BUTTON_A))
+        if (!ask_continue())
             goto restart_prompt;
     }
 
@@ -148,57 +585,240 @@ restart_program:
 
     Debug("Cart data size: %llu MB", (u64)cartSize * (u64)mediaUnit / 1024ull / 1024ull);
 
+    if (!cartdev_init(CARTDEV_CACHE_BLOCKS, (u64)cartSize * mediaUnit)) {
+        Debug("Out of memory for the cart cache!");
+        goto restart_prompt;
+    }
+
+    if (options.catalog) {
+        catalog_cart(ncsdHeader, ncchHeader, mediaUnit);
+        Debug("Took %lu ms", (unsigned long)(timer_elapsed_us(init_start) / 1000));
+        cartdev_report();
+        goto restart_prompt;
+    }
+
+    if (!check_signatures(ncsdHeader, ncchHeader, mediaUnit))
+        goto restart_prompt;
+
     struct Context context = {
         .buffer = (u8*)target,
         .buffer_size = target_buf_size,
         .cart_size = cartSize,
         .media_unit = mediaUnit,
+        .verify_buffer = options.verify_writes ? arena_alloc(DUMP_VERIFY_SIZE) : NULL,
+        .cart_id = Cart_GetID(),
+        .cart_header = ncchHeaderData,
+        .batch = batch_running,
     };
+    if (options.dual_read) {
+        context.compare_buffer = arena_alloc(dump_compare_size(mediaUnit));
+        context.vote_buffer = arena_alloc(DUMP_VOTE_READS * mediaUnit);
+        // Both or neither, voting writes through vote_buffer
+        if (context.compare_buffer == NULL || context.vote_buffer == NULL) {
+            Debug("Not enough memory for dual-read, reading once.");
+            context.compare_buffer = NULL;
+            context.vote_buffer = NULL;
+        }
+    }
+    dump_map_clear();
+    telemetry_reset();
+
+    struct NcchCrypto* crypto = NULL;
+    if (options.decrypt || options.extract) {
+        // Keys may have to be loaded from the SD card
+        crypto = arena_alloc(sizeof(struct NcchCrypto));
+        sd_mount();
+        u32 decrypted = ncch_plan_decrypt(crypto, ncsdHeader, mediaUnit);
+        sd_unmount();
+        if (options.decrypt) {
+            Debug("Decrypting %lu partitions.", (unsigned long)decrypted);
+            if (decrypted > 0)
+                context.decrypt = crypto;
+        }
+    }
+
+    if (options.extract) {
+        extract_game(crypto, (u64)ncsdHeader->offsetsize_table[0].offset * mediaUnit,
+                     (const char*)ncchHeader->product_code, (u8*)target, target_buf_size);
+        cartdev_report();
+        goto restart_prompt;
+    }
 
     // Maximum number of blocks in a single file
     u32 file_max_blocks = 0xFFFFFFFFu / mediaUnit; // 4GiB - 1
     u32 current_part = 0;
 
+    // The dump buffer overwrites the header
+    const NCSD_HEADER ncsd = *ncsdHeader;
+    // CIA output goes first if both are on
+    const bool split_partitions = options.split_partitions && !options.cia;
+    u32 partitions = 0;
+    if (split_partitions) {
+        partitions = options.skip_update ? ~UPDATE_PARTITIONS : ~0u;
+        if (!batch_running)
+            partitions = select_partitions(&ncsd, mediaUnit, partitions);
+        // All in one pass
+        file_max_blocks = cartSize;
+    }
+
+    struct CiaBuilder cia;
+    if (options.cia) {
+        cia_init(&cia, ncsdHeader, mediaUnit);
+        if (cia.total_size > 0xFFFFFFFFu) {
+            Debug("Too big for a CIA on FAT32!");
+            goto restart_prompt;
+        }
+        // A CIA can't be split, it's always one part
+        file_max_blocks = cartSize;
+    }
+
+    // The card info goes into the image as it's dumped, 0xFF fills the
+    // unused 0x1200-0x4000 area instead of random garbage
+    memset((u8*)ncchHeaderData + 0x200, 0xFF, DUMP_CARD_INFO_END - DUMP_CARD_INFO_START - 0x200);
+    if (!options.cia)
+        context.card_info = (const u8*)ncchHeaderData;
+
+    // The CIA needs the SHA engine for its own hashes. A split image is
+    // hashed as one, across all parts.
+    struct MultiHash* hashes = options.cia ? NULL : arena_alloc(sizeof(struct MultiHash));
+    u64 dump_us = 0;
+    context.hashes = hashes;
+
+    bool cancelled = false;
     while (current_part * file_max_blocks < cartSize) {
+        const u32 part_before = current_part;
         // Create output file
-        char filename_buf[32];
+        char dirname_buf[32] = "/";
+        char filename_buf[64];
         char extension_digit = cartSize <= file_max_blocks ? 's' : '0' + current_part;
-        snprintf(filename_buf, sizeof(filename_buf), "/%.16s.3d%c", ncchHeader->product_code, extension_digit);
-        Debug("Writing to file: \"%s\"", filename_buf);
-        Debug("Change the SD card now and/or press a key.");
-        Debug("(Or SELECT to cancel)");
-        if (InputWait() & BUTTON_SELECT)
+        if (options.title_dirs)
+            snprintf(dirname_buf, sizeof(dirname_buf), "/%.16s", ncchHeader->product_code);
+        if (options.cia)
+            snprintf(filename_buf, sizeof(filename_buf), "%s/%.16s.cia", options.title_dirs ? dirname_buf : "",
+                     ncchHeader->product_code);
+        else
+            snprintf(filename_buf, sizeof(filename_buf), "%s/%.16s.3d%c", options.title_dirs ? dirname_buf : "",
+                     ncchHeader->product_code, extension_digit);
+        if (split_partitions)
+            Debug("Writing partitions to \"%s\"", dirname_buf);
+        else
+            Debug("Writing to file: \"%s\"", filename_buf);
+        if (!wait_sd_swap())
             break;
 
-        if (f_mount(&fs, "0:", 0) != FR_OK) {
+        if (sd_mount() != FR_OK) {
             Debug("Failed to f_mount... Retrying");
             wait_key();
             goto cleanup_none;
         }
 
+        if (options.title_dirs) {
+            FRESULT res = f_mkdir(dirname_buf);
+            if (res != FR_OK && res != FR_EXIST) {
+                Debug("Failed to create directory... Retrying");
+                wait_key();
+                goto cleanup_mount;
+            }
+        }
+
+        // Looking up and creating the file then doesn't scan the directory.
+        // Only scans it if it isn't indexed on this mount yet.
+        if (f_indexdir(dirname_buf, dir_index, DIR_INDEX_SLOTS) != FR_OK)
+            Debug("Couldn't index output directory, continuing.");
+
+        size_t file_mark = arena_mark();
+        if (split_partitions) {
+            int res = dump_partitions(&ncsd, partitions, options.title_dirs ? dirname_buf : "",
+                                      (const char*)ncchHeader->product_code, &context);
+            cancelled = res == DUMP_CANCELLED;
+            if (res < 0)
+                goto cleanup_file;
+            goto part_done;
+        }
+
         if (f_open(&file, filename_buf, FA_READ | FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
             Debug("Failed to create file... Retrying");
             wait_key();
             goto cleanup_mount;
         }
 
-        f_lseek(&file, 0);
-
         u32 region_start = current_part * file_max_blocks;
         u32 region_end = region_start + file_max_blocks;
         if (region_end > cartSize)
             region_end = cartSize;
 
-        if (dump_cart_region(region_start, region_end, &file, &context) < 0)
+        DWORD file_size = options.cia ? (DWORD)cia.total_size : (region_end - region_start) * mediaUnit;
+        FRESULT prep_res = prepare_output_file(&file, file_size);
+        if (prep_res == FR_DENIED) {
+            Debug("Not enough space on the SD card!");
+            wait_key();
+            goto cleanup_file;
+        } else if (prep_res != FR_OK) {
+            Debug("Failed to allocate file... Retrying");
+            wait_key();
+            goto cleanup_file;
+        }
+
+        if (current_part == 0 && context.hashes != NULL && multihash_start(context.hashes) != SHA_OK) {
+            Debug("SHA engine not responding, no hashes.");
+            context.hashes = NULL;
+        }
+
+        u64 dump_start = timer_timestamp();
+        int dump_res = options.cia ? dump_cia_contents(&cia, &file, &context) :
+            dump_cart_region(region_start, region_end, &file, &context);
+        dump_us += timer_elapsed_us(dump_start);
+        if (dump_res < 0) {
+            // Don't leave the preallocated tail looking like dumped data
+            f_truncate(&file);
+            cancelled = dump_res == DUMP_CANCELLED;
+            // The hashes have part of this one in them already, only a
+            // retry of the first part can start them over
+            if (current_part > 0 && context.hashes != NULL) {
+                Debug("No hashes for this dump.");
+                context.hashes = NULL;
+            }
             goto cleanup_file;
+        }
+
+part_done:
+        if (context.verify_buffer != NULL) {
+            Debug("Verified, %lu ranges rewritten, %lu bad.", (unsigned long)context.verify_rewrites,
+                  (unsigned long)context.verify_failures);
+            if (context.verify_failures > 0)
+                Debug("The SD card may be faulty, don't trust this dump!");
+        }
 
-        if (current_part == 0) {
-            // Write header - TODO: Not sure why this is done at the very end..
-            f_lseek(&file, 0x1000);
-            unsigned int written = 0;
-            // Fill the 0x1200-0x4000 unused area with 0xFF instead of random garbage.
-            memset((u8*)ncchHeaderData + 0x200, 0xFF, 0x3000 - 0x200);
-            f_write(&file, ncchHeader, 0x3000, &written);
+        bool last_part = (current_part + 1) * file_max_blocks >= cartSize;
+        if (last_part && (context.compare_buffer != NULL || !dump_map_empty())) {
+            // Error map of the whole cart goes next to the last part
+            snprintf(filename_buf, sizeof(filename_buf), "%s/%.16s.map", options.title_dirs ? dirname_buf : "",
+                     ncchHeader->product_code);
+            if (context.compare_buffer != NULL)
+                Debug("Fixed %lu blocks, %lu bad.", (unsigned long)dump_map_count(DUMP_ERROR_FIXED),
+                      (unsigned long)dump_map_count(DUMP_ERROR_BAD));
+            Debug("Read retries fixed %lu blocks, %lu failed.", (unsigned long)dump_map_count(DUMP_ERROR_RETRIED),
+                  (unsigned long)(dump_map_count(DUMP_ERROR_CRC) + dump_map_count(DUMP_ERROR_SHORT) +
+                                  dump_map_count(DUMP_ERROR_TIMEOUT)));
+            if (write_error_map(filename_buf, (const char*)ncchHeader->product_code) != FR_OK)
+                Debug("Failed to write \"%s\"", filename_buf);
+        }
+
+        if (last_part && !split_partitions && context.hashes != NULL) {
+            if (multihash_finish(context.hashes) != SHA_OK) {
+                Debug("Hashing failed, no hashes written.");
+            } else {
+                snprintf(filename_buf, sizeof(filename_buf), "%s/%.16s.hashes", options.title_dirs ? dirname_buf : "",
+                         ncchHeader->product_code);
+                if (write_manifest(filename_buf, (const char*)ncchHeader->product_code, context.hashes) != FR_OK)
+                    Debug("Failed to write \"%s\"", filename_buf);
+                multihash_report(context.hashes, dump_us);
+                // The index is of cart images as they come off the cart
+                if (context.decrypt != NULL)
+                    Debug("Decrypted, not comparable with known good dumps.");
+                else
+                    check_known_good((const char*)ncchHeader->product_code, context.hashes);
+            }
         }
 
         Debug("Done!");
@@ -208,13 +828,28 @@ cleanup_file:
         // Done, clean up...
         f_sync(&file);
         f_close(&file);
+        arena_release(file_mark);
 cleanup_mount:
-        f_mount(NULL, "0:", 0);
+        sd_unmount();
 cleanup_none:
-        ;
+        if (cancelled) {
+            Debug("Dump cancelled.");
+            break;
+        }
+        // Batch mode doesn't retry, the cart is done with either way
+        if (batch_running && current_part == part_before) {
+            Debug("Failed, moving on to the next cart.");
+            break;
+        }
     }
 
 restart_prompt:
+    if (batch_running) {
+        Debug("Remove the cart for the next one, B to stop.");
+        if (!wait_cart(false))
+            stop_batch();
+        goto restart_program;
+    }
     Debug("Press B to exit, any other key to restart.");
     if (!(InputWait() & BUTTON_B))
         goto restart_program;
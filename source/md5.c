@@ -0,0 +1,148 @@
+#include "md5.h"
+
+#define F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define H(x, y, z) ((x) ^ (y) ^ (z))
+#define I(x, y, z) ((y) ^ ((x) | ~(z)))
+
+#define STEP(f, a, b, c, d, x, k, s) \
+    do { \
+        a += f(b, c, d) + (x) + (k); \
+        a = (a << (s)) | (a >> (32 - (s))); \
+        a += b; \
+    } while (0)
+
+void md5_init(struct Md5* md5) {
+    md5->state[0] = 0x67452301;
+    md5->state[1] = 0xEFCDAB89;
+    md5->state[2] = 0x98BADCFE;
+    md5->state[3] = 0x10325476;
+    md5->size = 0;
+}
+
+// All 64 steps written out, so the constants and shifts are immediates
+ARM_CODE static void md5_blocks(u32* state, const u32* x, size_t blocks) {
+    u32 a = state[0], b = state[1], c = state[2], d = state[3];
+
+    for (; blocks > 0; --blocks, x += 16) {
+        const u32 aa = a, bb = b, cc = c, dd = d;
+
+        STEP(F, a, b, c, d, x[0], 0xD76AA478, 7);
+        STEP(F, d, a, b, c, x[1], 0xE8C7B756, 12);
+        STEP(F, c, d, a, b, x[2], 0x242070DB, 17);
+        STEP(F, b, c, d, a, x[3], 0xC1BDCEEE, 22);
+        STEP(F, a, b, c, d, x[4], 0xF57C0FAF, 7);
+        STEP(F, d, a, b, c, x[5], 0x4787C62A, 12);
+        STEP(F, c, d, a, b, x[6], 0xA8304613, 17);
+        STEP(F, b, c, d, a, x[7], 0xFD469501, 22);
+        STEP(F, a, b, c, d, x[8], 0x698098D8, 7);
+        STEP(F, d, a, b, c, x[9], 0x8B44F7AF, 12);
+        STEP(F, c, d, a, b, x[10], 0xFFFF5BB1, 17);
+        STEP(F, b, c, d, a, x[11], 0x895CD7BE, 22);
+        STEP(F, a, b, c, d, x[12], 0x6B901122, 7);
+        STEP(F, d, a, b, c, x[13], 0xFD987193, 12);
+        STEP(F, c, d, a, b, x[14], 0xA679438E, 17);
+        STEP(F, b, c, d, a, x[15], 0x49B40821, 22);
+
+        STEP(G, a, b, c, d, x[1], 0xF61E2562, 5);
+        STEP(G, d, a, b, c, x[6], 0xC040B340, 9);
+        STEP(G, c, d, a, b, x[11], 0x265E5A51, 14);
+        STEP(G, b, c, d, a, x[0], 0xE9B6C7AA, 20);
+        STEP(G, a, b, c, d, x[5], 0xD62F105D, 5);
+        STEP(G, d, a, b, c, x[10], 0x02441453, 9);
+        STEP(G, c, d, a, b, x[15], 0xD8A1E681, 14);
+        STEP(G, b, c, d, a, x[4], 0xE7D3FBC8, 20);
+        STEP(G, a, b, c, d, x[9], 0x21E1CDE6, 5);
+        STEP(G, d, a, b, c, x[14], 0xC33707D6, 9);
+        STEP(G, c, d, a, b, x[3], 0xF4D50D87, 14);
+        STEP(G, b, c, d, a, x[8], 0x455A14ED, 20);
+        STEP(G, a, b, c, d, x[13], 0xA9E3E905, 5);
+        STEP(G, d, a, b, c, x[2], 0xFCEFA3F8, 9);
+        STEP(G, c, d, a, b, x[7], 0x676F02D9, 14);
+        STEP(G, b, c, d, a, x[12], 0x8D2A4C8A, 20);
+
+        STEP(H, a, b, c, d, x[5], 0xFFFA3942, 4);
+        STEP(H, d, a, b, c, x[8], 0x8771F681, 11);
+        STEP(H, c, d, a, b, x[11], 0x6D9D6122, 16);
+        STEP(H, b, c, d, a, x[14], 0xFDE5380C, 23);
+        STEP(H, a, b, c, d, x[1], 0xA4BEEA44, 4);
+        STEP(H, d, a, b, c, x[4], 0x4BDECFA9, 11);
+        STEP(H, c, d, a, b, x[7], 0xF6BB4B60, 16);
+        STEP(H, b, c, d, a, x[10], 0xBEBFBC70, 23);
+        STEP(H, a, b, c, d, x[13], 0x289B7EC6, 4);
+        STEP(H, d, a, b, c, x[0], 0xEAA127FA, 11);
+        STEP(H, c, d, a, b, x[3], 0xD4EF3085, 16);
+        STEP(H, b, c, d, a, x[6], 0x04881D05, 23);
+        STEP(H, a, b, c, d, x[9], 0xD9D4D039, 4);
+        STEP(H, d, a, b, c, x[12], 0xE6DB99E5, 11);
+        STEP(H, c, d, a, b, x[15], 0x1FA27CF8, 16);
+        STEP(H, b, c, d, a, x[2], 0xC4AC5665, 23);
+
+        STEP(I, a, b, c, d, x[0], 0xF4292244, 6);
+        STEP(I, d, a, b, c, x[7], 0x432AFF97, 10);
+        STEP(I, c, d, a, b, x[14], 0xAB9423A7, 15);
+        STEP(I, b, c, d, a, x[5], 0xFC93A039, 21);
+        STEP(I, a, b, c, d, x[12], 0x655B59C3, 6);
+        STEP(I, d, a, b, c, x[3], 0x8F0CCC92, 10);
+        STEP(I, c, d, a, b, x[10], 0xFFEFF47D, 15);
+        STEP(I, b, c, d, a, x[1], 0x85845DD1, 21);
+        STEP(I, a, b, c, d, x[8], 0x6FA87E4F, 6);
+        STEP(I, d, a, b, c, x[15], 0xFE2CE6E0, 10);
+        STEP(I, c, d, a, b, x[6], 0xA3014314, 15);
+        STEP(I, b, c, d, a, x[13], 0x4E0811A1, 21);
+        STEP(I, a, b, c, d, x[4], 0xF7537E82, 6);
+        STEP(I, d, a, b, c, x[11], 0xBD3AF235, 10);
+        STEP(I, c, d, a, b, x[2], 0x2AD7D2BB, 15);
+        STEP(I, b, c, d, a, x[9], 0xEB86D391, 21);
+
+        a += aa;
+        b += bb;
+        c += cc;
+        d += dd;
+    }
+
+    state[0] = a;
+    state[1] = b;
+    state[2] = c;
+    state[3] = d;
+}
+
+void md5_update(struct Md5* md5, const void* data, size_t size) {
+    const u8* src = data;
+    u32 used = md5->size & (MD5_BLOCK_SIZE - 1);
+
+    md5->size += size;
+    if (used > 0) {
+        const u32 take = size < MD5_BLOCK_SIZE - used ? size : MD5_BLOCK_SIZE - used;
+        memcpy(md5->block + used, src, take);
+        src += take;
+        size -= take;
+        if (used + take < MD5_BLOCK_SIZE)
+            return;
+        md5_blocks(md5->state, (const u32*)md5->block, 1);
+    }
+
+    // The words are read little endian, as the ARM9 runs
+    if (!((u32)src & 3)) {
+        md5_blocks(md5->state, (const u32*)src, size / MD5_BLOCK_SIZE);
+        src += size & ~(size_t)(MD5_BLOCK_SIZE - 1);
+        size &= MD5_BLOCK_SIZE - 1;
+    }
+    for (; size >= MD5_BLOCK_SIZE; size -= MD5_BLOCK_SIZE, src += MD5_BLOCK_SIZE) {
+        memcpy(md5->block, src, MD5_BLOCK_SIZE);
+        md5_blocks(md5->state, (const u32*)md5->block, 1);
+    }
+    memcpy(md5->block, src, size);
+}
+
+void md5_final(struct Md5* md5, void* hash) {
+    const u64 bits = md5->size * 8;
+    u8 pad[MD5_BLOCK_SIZE + 8] = { 0x80 };
+    const u32 used = md5->size & (MD5_BLOCK_SIZE - 1);
+    const u32 pad_size = (used < 56 ? 56 : 120) - used;
+
+    for (int i = 0; i < 8; ++i)
+        pad[pad_size + i] = bits >> (i * 8);
+    md5_update(md5, pad, pad_size + 8);
+    memcpy(hash, md5->state, MD5_HASH_SIZE);
+}
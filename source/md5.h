@@ -0,0 +1,18 @@
+#pragma once
+
+#include "common.h"
+
+#define MD5_BLOCK_SIZE 64u
+#define MD5_HASH_SIZE  16u
+
+// MD5 in software, the SHA engine doesn't do it. Feed the data in pieces of
+// any size, whole blocks at word aligned addresses go straight through.
+struct Md5 {
+    u32 state[4];
+    u64 size;
+    u8 block[MD5_BLOCK_SIZE];
+};
+
+void md5_init(struct Md5* md5);
+void md5_update(struct Md5* md5, const void* data, size_t size);
+void md5_final(struct Md5* md5, void* hash);
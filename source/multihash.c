@@ -0,0 +1,93 @@
+#include "multihash.h"
+#include "crc32.h"
+#include "draw.h"
+#include "timer.h"
+
+#include <stdio.h>
+
+int multihash_start(struct MultiHash* hash) {
+    memset(hash, 0, sizeof(*hash));
+    md5_init(&hash->md5);
+    return sha_init(SHA_MODE_1);
+}
+
+// A block goes to the engine first, and is hashed by the CPU while the
+// engine works on it. Each block is loaded into the cache once for all
+// three.
+int multihash_update(struct MultiHash* hash, const void* data, size_t size) {
+    const u32 start = timer_ticks();
+    const u8* src = data;
+    int res = SHA_OK;
+
+    hash->size += size;
+    while (size > 0) {
+        const size_t block = size < SHA_BLOCK_SIZE ? size : SHA_BLOCK_SIZE;
+
+        res = sha_update(src, block);
+        if (res != SHA_OK)
+            break;
+        md5_update(&hash->md5, src, block);
+        hash->crc32 = crc32_update(hash->crc32, src, block);
+
+        src += block;
+        size -= block;
+    }
+
+    hash->ticks += timer_ticks() - start;
+    return res;
+}
+
+int multihash_finish(struct MultiHash* hash) {
+    md5_final(&hash->md5, hash->md5_hash);
+    return sha_get(hash->sha1_hash, SHA_MODE_1);
+}
+
+static FRESULT write_text(FIL* fp, const char* text, size_t size) {
+    UINT written = 0;
+    FRESULT res = f_write(fp, text, size, &written);
+    if (res == FR_OK && written != size)
+        res = FR_DENIED;
+    return res;
+}
+
+static void hex(char* out, const u8* data, size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < size; ++i) {
+        *out++ = digits[data[i] >> 4];
+        *out++ = digits[data[i] & 0xF];
+    }
+    *out = '\0';
+}
+
+FRESULT multihash_write_header(FIL* fp, const char* title) {
+    char line[128];
+    int len = snprintf(line, sizeof(line), "# Uncart hashes for %.16s\n"
+                       "# size crc32 md5 sha1 file\n", title);
+    return write_text(fp, line, len);
+}
+
+FRESULT multihash_write_line(FIL* fp, const struct MultiHash* hash, const char* name) {
+    char md5[MD5_HASH_SIZE * 2 + 1];
+    char sha1[SHA_1_HASH_SIZE * 2 + 1];
+    char line[160];
+
+    hex(md5, hash->md5_hash, sizeof(hash->md5_hash));
+    hex(sha1, hash->sha1_hash, sizeof(hash->sha1_hash));
+    int len = snprintf(line, sizeof(line), "%llu %08lx %s %s %.48s\n", hash->size,
+                       (unsigned long)hash->crc32, md5, sha1, name);
+    if (len < 0 || (size_t)len >= sizeof(line))
+        return FR_INVALID_NAME;
+    return write_text(fp, line, len);
+}
+
+void multihash_report(const struct MultiHash* hash, u64 dump_us) {
+    const u64 hash_us = TIMER_TICKS_TO_US(hash->ticks);
+    const u32 mb = (u32)(hash->size >> 20);
+
+    if (hash_us == 0 || dump_us == 0)
+        return;
+    Debug("Hashed %lu MB at %lu KB/s, dump ran at %lu KB/s", (unsigned long)mb,
+          (unsigned long)(hash->size * 1000000 / 1024 / hash_us),
+          (unsigned long)(hash->size * 1000000 / 1024 / dump_us));
+    Debug("Hashing took %lu%% of the dump time.", (unsigned long)(hash_us * 100 / dump_us));
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "common.h"
+#include "fatfs/ff.h"
+#include "md5.h"
+#include "sha.h"
+
+// CRC32, MD5 and SHA-1 of a dump in one pass, as the preservation
+// databases list them. SHA-1 runs on the SHA engine while the CPU does the
+// other two, so nothing else may use the engine until the hash is done.
+struct MultiHash {
+    u64 size;
+    u32 crc32;
+    struct Md5 md5;
+    u8 md5_hash[MD5_HASH_SIZE];
+    u8 sha1_hash[SHA_1_HASH_SIZE];
+
+    // Time spent in multihash_update(), to compare with the cart
+    u64 ticks;
+};
+
+// Return SHA_OK or SHA_ERR_TIMEOUT
+int multihash_start(struct MultiHash* hash);
+int multihash_update(struct MultiHash* hash, const void* data, size_t size);
+int multihash_finish(struct MultiHash* hash);
+
+// Manifest next to the dump, a line per file with its size and hashes
+FRESULT multihash_write_header(FIL* fp, const char* title);
+FRESULT multihash_write_line(FIL* fp, const struct MultiHash* hash, const char* name);
+
+// Prints how fast the hashes ran next to how fast the whole dump ran
+void multihash_report(const struct MultiHash* hash, u64 dump_us);
@@ -0,0 +1,420 @@
+#include "ncch.h"
+#include "aes.h"
+#include "cartdev.h"
+#include "draw.h"
+#include "fatfs/ff.h"
+#include "gamecart/protocol_ctr.h"
+
+#include <stddef.h>
+
+#define NCCH_KEYSLOT_PRIMARY 0x2Cu
+// Fixed key titles use an all-zero normal key, the same as dev carts
+#define NCCH_KEYSLOT_FIXED   AES_KEYSLOT_CART_DEV
+
+// flags[3]
+#define NCCH_FLAG_CRYPTO_METHOD 3
+// flags[7]
+#define NCCH_FLAG_CRYPTO        7
+#define NCCH_FIXED_KEY          0x01u
+#define NCCH_NO_CRYPTO          0x04u
+#define NCCH_SEED_CRYPTO        0x20u
+
+#define NCCH_SECTION_EXHEADER   1u
+#define NCCH_SECTION_EXEFS      2u
+#define NCCH_SECTION_ROMFS      3u
+
+// Exheader and access descriptor
+#define NCCH_EXHEADER_OFFSET    0x200u
+#define NCCH_EXHEADER_SIZE      0x800u
+
+#define EXEFS_HEADER_SIZE       0x200u
+#define EXEFS_MAX_FILES         10
+
+struct ExefsFile {
+    char name[8];
+    u32 offset;
+    u32 size;
+};
+
+// Keyslots of the secondary key for each crypto method. The key X of the
+// newer ones is set by the firmware, it has to come from the SD card when
+// running before it.
+static const struct {
+    u8 method;
+    u8 keyslot;
+    const char* keyx_file;
+} secondary_keys[] = {
+    { 0x00, 0x2C, NULL },
+    { 0x01, 0x25, "/slot0x25KeyX.bin" },
+    { 0x0A, 0x18, "/slot0x18KeyX.bin" },
+    { 0x0B, 0x1B, "/slot0x1BKeyX.bin" },
+};
+
+struct KeySetup {
+    u8 keyslot;
+    u8 key_type;
+    u8 key[16];
+};
+
+static u32 getle32(const u8* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24);
+}
+
+static bool load_keyx(u32 keyslot, const char* path) {
+    u8 keyx[16];
+    FIL fp;
+    UINT bytes_read = 0;
+
+    if (f_open(&fp, path, FA_READ) != FR_OK)
+        return false;
+    f_read(&fp, keyx, sizeof(keyx), &bytes_read);
+    f_close(&fp);
+    if (bytes_read != sizeof(keyx))
+        return false;
+
+    aes_setkey(keyslot, keyx, AES_KEY_X);
+    return true;
+}
+
+// Whether the key X of the secondary keyslot may be there. Running after
+// the firmware it should be, that's checked against the RomFS later.
+static bool secondary_keyslot(u8 method, u8* keyslot) {
+    for (size_t i = 0; i < sizeof(secondary_keys) / sizeof(secondary_keys[0]); ++i) {
+        if (secondary_keys[i].method != method)
+            continue;
+
+        *keyslot = secondary_keys[i].keyslot;
+        if (secondary_keys[i].keyx_file == NULL || load_keyx(*keyslot, secondary_keys[i].keyx_file))
+            return true;
+#ifdef A9LH
+        return false;
+#else
+        return true;
+#endif
+    }
+    return false;
+}
+
+static void section_ctr(u8* ctr, const NCCH_HEADER* header, u32 section, u32 offset) {
+    memset(ctr, 0, 16);
+    if ((header->version[0] | (header->version[1] << 8)) == 1) {
+        memcpy(ctr, header->title_id, 8);
+        ctr[12] = offset >> 24;
+        ctr[13] = offset >> 16;
+        ctr[14] = offset >> 8;
+        ctr[15] = offset;
+    } else {
+        for (int i = 0; i < 8; ++i)
+            ctr[i] = header->title_id[7 - i];
+        ctr[8] = section;
+    }
+}
+
+static bool add_region(struct NcchCrypto* crypto, u64 start, u64 end, const u8* section_ctr,
+                       u64 section_start, const struct KeySetup* key) {
+    if (start >= end)
+        return true;
+    if (crypto->region_count == NCCH_MAX_REGIONS)
+        return false;
+
+    struct NcchRegion* region = &crypto->regions[crypto->region_count++];
+    region->start = start;
+    region->end = end;
+    memcpy(region->ctr, section_ctr, 16);
+    aes_ctr_add(region->ctr, (u32)((start - section_start) / AES_BLOCK_SIZE));
+    memcpy(region->key, key->key, 16);
+    region->keyslot = key->keyslot;
+    region->key_type = key->key_type;
+    return true;
+}
+
+static void use_key(const struct KeySetup* key) {
+    aes_setkey(key->keyslot, key->key, key->key_type);
+    aes_use_keyslot(key->keyslot);
+}
+
+// The ExeFS header and the icon and banner use the primary key, the other
+// files the secondary one. Gaps between files go with the primary key.
+static bool plan_exefs(struct NcchCrypto* crypto, u64 start, u64 end, const u8* ctr,
+                       const struct KeySetup* primary, const struct KeySetup* secondary) {
+    if (primary->keyslot == secondary->keyslot)
+        return add_region(crypto, start, end, ctr, start, primary);
+
+    u32 header[EXEFS_HEADER_SIZE / 4];
+    u8 header_ctr[16];
+    if (cartdev_read(start, EXEFS_HEADER_SIZE, header) != CTRCARD_OK)
+        return false;
+    memcpy(header_ctr, ctr, 16);
+    use_key(primary);
+    if (aes_ctr(header, header, EXEFS_HEADER_SIZE / AES_BLOCK_SIZE, header_ctr) != AES_OK)
+        return false;
+
+    // Files that need the secondary key, by offset
+    struct ExefsFile files[EXEFS_MAX_FILES];
+    u32 count = 0;
+    for (u32 i = 0; i < EXEFS_MAX_FILES; ++i) {
+        struct ExefsFile file;
+        memcpy(&file, (const u8*)header + i * sizeof(file), sizeof(file));
+        if (file.size == 0 || !strncmp(file.name, "icon", 8) || !strncmp(file.name, "banner", 8))
+            continue;
+
+        u32 pos = count;
+        while (pos > 0 && files[pos - 1].offset > file.offset) {
+            files[pos] = files[pos - 1];
+            --pos;
+        }
+        files[pos] = file;
+        ++count;
+    }
+
+    u64 cursor = start;
+    for (u32 i = 0; i < count; ++i) {
+        u64 file_start = start + EXEFS_HEADER_SIZE + files[i].offset;
+        u64 file_end = file_start + files[i].size;
+        if (file_start < cursor || file_end > end)
+            return false;
+        if (!add_region(crypto, cursor, file_start, ctr, start, primary) ||
+            !add_region(crypto, file_start, file_end, ctr, start, secondary))
+            return false;
+        cursor = file_end;
+    }
+    return add_region(crypto, cursor, end, ctr, start, primary);
+}
+
+// A decrypted RomFS starts with the IVFC magic, which tells whether the
+// secondary key is the right one
+static bool check_romfs_key(u64 start, const u8* ctr, const struct KeySetup* key) {
+    u32 block[0x200 / 4];
+    u8 block_ctr[16];
+
+    if (cartdev_read(start, sizeof(block), block) != CTRCARD_OK)
+        return false;
+    memcpy(block_ctr, ctr, 16);
+    use_key(key);
+    if (aes_ctr(block, block, 1, block_ctr) != AES_OK)
+        return false;
+    return !memcmp(block, "IVFC", 4);
+}
+
+static bool plan_partition(struct NcchCrypto* crypto, u32 index, u64 base) {
+    u32 header_data[0x200 / 4];
+    const NCCH_HEADER* header = (const NCCH_HEADER*)header_data;
+
+    if (cartdev_read(base, sizeof(header_data), header_data) != CTRCARD_OK ||
+        memcmp(header->magic, "NCCH", 4))
+        return false;
+
+    const u8 crypto_flags = header->flags[NCCH_FLAG_CRYPTO];
+    if (crypto_flags & NCCH_NO_CRYPTO) {
+        crypto->readable |= 1u << index;
+        return false;
+    }
+    if (crypto_flags & NCCH_SEED_CRYPTO) {
+        Debug("Partition %lu uses seed crypto, left encrypted.", (unsigned long)index);
+        return false;
+    }
+
+    struct KeySetup primary, secondary;
+    if (crypto_flags & NCCH_FIXED_KEY) {
+        // System titles use a fixed key that isn't known here
+        if (header->program_id[4] & 0x10) {
+            Debug("Partition %lu uses the system key, left encrypted.", (unsigned long)index);
+            return false;
+        }
+        primary.keyslot = NCCH_KEYSLOT_FIXED;
+        primary.key_type = AES_KEY_NORMAL;
+        memset(primary.key, 0, sizeof(primary.key));
+        secondary = primary;
+    } else {
+        primary.keyslot = NCCH_KEYSLOT_PRIMARY;
+        primary.key_type = AES_KEY_Y;
+        memcpy(primary.key, header->sha256, sizeof(primary.key));
+        secondary = primary;
+        if (!secondary_keyslot(header->flags[NCCH_FLAG_CRYPTO_METHOD], &secondary.keyslot)) {
+            Debug("Partition %lu: key 0x%02X missing, left encrypted.", (unsigned long)index,
+                  header->flags[NCCH_FLAG_CRYPTO_METHOD]);
+            return false;
+        }
+    }
+
+    const u32 unit = 0x200u << header->flags[6];
+    const u32 regions_before = crypto->region_count;
+    bool ok = true;
+    u8 ctr[16];
+
+    if (getle32(header->extended_header_size) != 0) {
+        section_ctr(ctr, header, NCCH_SECTION_EXHEADER, NCCH_EXHEADER_OFFSET);
+        u64 start = base + NCCH_EXHEADER_OFFSET;
+        ok = ok && add_region(crypto, start, start + NCCH_EXHEADER_SIZE, ctr, start, &primary);
+    }
+
+    if (getle32(header->exefs_size) != 0) {
+        const u32 offset = getle32(header->exefs_offset) * unit;
+        section_ctr(ctr, header, NCCH_SECTION_EXEFS, offset);
+        u64 start = base + offset;
+        ok = ok && plan_exefs(crypto, start, start + (u64)getle32(header->exefs_size) * unit, ctr,
+                              &primary, &secondary);
+    }
+
+    if (getle32(header->romfs_size) != 0) {
+        const u32 offset = getle32(header->romfs_offset) * unit;
+        section_ctr(ctr, header, NCCH_SECTION_ROMFS, offset);
+        u64 start = base + offset;
+        if (ok && !check_romfs_key(start, ctr, &secondary)) {
+            Debug("Partition %lu: wrong key 0x%02X, left encrypted.", (unsigned long)index,
+                  header->flags[NCCH_FLAG_CRYPTO_METHOD]);
+            crypto->region_count = regions_before;
+            return false;
+        }
+        ok = ok && add_region(crypto, start, start + (u64)getle32(header->romfs_size) * unit, ctr,
+                              start, &secondary);
+    }
+
+    if (!ok) {
+        Debug("Partition %lu: bad header, left encrypted.", (unsigned long)index);
+        crypto->region_count = regions_before;
+        return false;
+    }
+
+    crypto->headers[crypto->header_count++] = base;
+    crypto->readable |= 1u << index;
+    return true;
+}
+
+u32 ncch_plan_decrypt(struct NcchCrypto* crypto, const NCSD_HEADER* ncsd, u32 media_unit) {
+    crypto->region_count = 0;
+    crypto->header_count = 0;
+    crypto->readable = 0;
+
+    for (u32 i = 0; i < NCCH_MAX_PARTITIONS; ++i) {
+        if (ncsd->offsetsize_table[i].size != 0)
+            plan_partition(crypto, i, (u64)ncsd->offsetsize_table[i].offset * media_unit);
+    }
+    return crypto->header_count;
+}
+
+// Decrypts [start, end) of a region, data being the chunk at cart offset
+// offset. Chunks are aligned to the media unit, so the 16-byte blocks the
+// ends fall into are always in the chunk.
+static int decrypt_range(const struct NcchRegion* region, u64 offset, u8* data, u64 start, u64 end) {
+    u8 ctr[16];
+    u8 block[AES_BLOCK_SIZE];
+    u64 block_start = start & ~(u64)(AES_BLOCK_SIZE - 1);
+
+    memcpy(ctr, region->ctr, 16);
+    aes_ctr_add(ctr, (u32)((block_start - (region->start & ~(u64)(AES_BLOCK_SIZE - 1))) / AES_BLOCK_SIZE));
+    aes_setkey(region->keyslot, region->key, region->key_type);
+    aes_use_keyslot(region->keyslot);
+
+    while (start < end) {
+        const u32 skip = start - block_start;
+        u32 full_blocks = (u32)((end - block_start) / AES_BLOCK_SIZE);
+
+        if (skip == 0 && full_blocks > 0) {
+            if (aes_ctr(data + (start - offset), data + (start - offset), full_blocks, ctr) != AES_OK)
+                return -1;
+            start += (u64)full_blocks * AES_BLOCK_SIZE;
+        } else {
+            // Only part of this block belongs to the region
+            u32 length = AES_BLOCK_SIZE - skip;
+            if (end - start < length)
+                length = (u32)(end - start);
+            memcpy(block, data + (block_start - offset), AES_BLOCK_SIZE);
+            if (aes_ctr(block, block, 1, ctr) != AES_OK)
+                return -1;
+            memcpy(data + (start - offset), block + skip, length);
+            start += length;
+        }
+        block_start = start & ~(u64)(AES_BLOCK_SIZE - 1);
+    }
+    return 0;
+}
+
+int ncch_decrypt_chunk(const struct NcchCrypto* crypto, u64 offset, u8* data, u32 size) {
+    const u64 chunk_end = offset + size;
+
+    for (u32 i = 0; i < crypto->region_count; ++i) {
+        const struct NcchRegion* region = &crypto->regions[i];
+        u64 start = region->start > offset ? region->start : offset;
+        u64 end = region->end < chunk_end ? region->end : chunk_end;
+        if (start < end && decrypt_range(region, offset, data, start, end) < 0)
+            return -1;
+    }
+
+    for (u32 i = 0; i < crypto->header_count; ++i) {
+        if (crypto->headers[i] < offset || crypto->headers[i] + sizeof(NCCH_HEADER) > chunk_end)
+            continue;
+        NCCH_HEADER* header = (NCCH_HEADER*)(data + (crypto->headers[i] - offset));
+        header->flags[NCCH_FLAG_CRYPTO_METHOD] = 0;
+        header->flags[NCCH_FLAG_CRYPTO] = (header->flags[NCCH_FLAG_CRYPTO] &
+            ~(NCCH_FIXED_KEY | NCCH_SEED_CRYPTO)) | NCCH_NO_CRYPTO;
+    }
+    return 0;
+}
+
+int ncch_read_exheader(const NCCH_HEADER* header, u64 base, void* exheader) {
+    u8 ctr[16];
+    const u8 crypto_flags = header->flags[NCCH_FLAG_CRYPTO];
+
+    if (getle32(header->extended_header_size) == 0)
+        return CTRCARD_ERR_SHORT;
+    int res = cartdev_read(base + NCCH_EXHEADER_OFFSET, NCCH_EXHEADER_SIZE, exheader);
+    if (res != CTRCARD_OK || (crypto_flags & NCCH_NO_CRYPTO))
+        return res;
+
+    struct KeySetup key;
+    if (crypto_flags & NCCH_FIXED_KEY) {
+        if (header->program_id[4] & 0x10)
+            return CTRCARD_ERR_SHORT;
+        key.keyslot = NCCH_KEYSLOT_FIXED;
+        key.key_type = AES_KEY_NORMAL;
+        memset(key.key, 0, sizeof(key.key));
+    } else {
+        key.keyslot = NCCH_KEYSLOT_PRIMARY;
+        key.key_type = AES_KEY_Y;
+        memcpy(key.key, header->sha256, sizeof(key.key));
+    }
+
+    section_ctr(ctr, header, NCCH_SECTION_EXHEADER, NCCH_EXHEADER_OFFSET);
+    use_key(&key);
+    if (aes_ctr(exheader, exheader, NCCH_EXHEADER_SIZE / AES_BLOCK_SIZE, ctr) != AES_OK)
+        return CTRCARD_ERR_TIMEOUT;
+    return CTRCARD_OK;
+}
+
+int ncch_read(const struct NcchCrypto* crypto, u64 offset, u32 size, void* dest) {
+    u8* out = dest;
+    u8 block[AES_BLOCK_SIZE];
+
+    while (size > 0) {
+        const u32 skip = (u32)(offset & (AES_BLOCK_SIZE - 1));
+        int res;
+
+        if (skip == 0 && size >= AES_BLOCK_SIZE) {
+            const u32 length = size & ~(AES_BLOCK_SIZE - 1);
+            res = cartdev_read(offset, length, out);
+            if (res == CTRCARD_OK && ncch_decrypt_chunk(crypto, offset, out, length) < 0)
+                res = CTRCARD_ERR_TIMEOUT;
+            if (res != CTRCARD_OK)
+                return res;
+            out += length;
+            offset += length;
+            size -= length;
+        } else {
+            // Partial block, decrypted whole on the side
+            u32 length = AES_BLOCK_SIZE - skip;
+            if (size < length)
+                length = size;
+            res = cartdev_read(offset - skip, AES_BLOCK_SIZE, block);
+            if (res == CTRCARD_OK && ncch_decrypt_chunk(crypto, offset - skip, block, AES_BLOCK_SIZE) < 0)
+                res = CTRCARD_ERR_TIMEOUT;
+            if (res != CTRCARD_OK)
+                return res;
+            memcpy(out, block + skip, length);
+            out += length;
+            offset += length;
+            size -= length;
+        }
+    }
+    return CTRCARD_OK;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "common.h"
+#include "headers.h"
+
+// Decryption of the NCCH partitions of a cart while it's dumped. The plan
+// is built from the partition headers before the dump and applied to every
+// chunk before it's written. Offsets are bytes into the cart image.
+
+// Exheader, ExeFS header, up to 10 ExeFS files with gaps and RomFS for
+// each of the 8 partitions
+#define NCCH_MAX_REGIONS 128
+
+#define NCCH_MAX_PARTITIONS 8
+
+// A range decrypted with one key and a continuous counter. Ranges may
+// start and end anywhere, ctr is the counter of the 16-byte block start
+// falls in.
+struct NcchRegion {
+    u64 start;
+    u64 end;
+    u8 ctr[16];
+    u8 key[16];
+    u8 keyslot;
+    u8 key_type;
+};
+
+struct NcchCrypto {
+    u32 region_count;
+    struct NcchRegion regions[NCCH_MAX_REGIONS];
+
+    // Headers of the partitions that are decrypted, their crypto flags are
+    // changed to say so
+    u32 header_count;
+    u64 headers[NCCH_MAX_PARTITIONS];
+
+    // Partitions that read as plain data through the plan, because they
+    // are decrypted by it or not encrypted at all
+    u32 readable;
+};
+
+// Reads the partition headers from the cart and plans the decryption of
+// all encrypted partitions the keys are available for. Keys missing from
+// the hardware are loaded from slot0x??KeyX.bin files in the root of the
+// SD card, which must be mounted. Returns the number of partitions that
+// will be decrypted, the others are dumped as they are.
+u32 ncch_plan_decrypt(struct NcchCrypto* crypto, const NCSD_HEADER* ncsd, u32 media_unit);
+
+// Decrypts what the plan covers of size bytes at cart offset offset.
+// Returns 0, or -1 if the AES engine failed.
+int ncch_decrypt_chunk(const struct NcchCrypto* crypto, u64 offset, u8* data, u32 size);
+
+// Reads size bytes at any cart offset through the cart cache and decrypts
+// them as the plan says. Returns CTRCARD_OK or an error.
+int ncch_read(const struct NcchCrypto* crypto, u64 offset, u32 size, void* dest);
+
+// Reads the 0x800 byte exheader and access descriptor of the partition at
+// cart offset base, decrypted with the primary key. Needs no plan, the
+// primary key is always available. Returns CTRCARD_OK or an error.
+int ncch_read_exheader(const NCCH_HEADER* header, u64 base, void* exheader);
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "common.h"
+
+#define REG_NDMA_GLOBAL_CNT (*(vu32*)0x10002000)
+
+// Eight channels of 0x1C bytes each
+#define NDMA_CHANNEL(n)     (0x10002004 + 0x1C * (n))
+#define REG_NDMA_SAD(n)     (*(vu32*)(NDMA_CHANNEL(n) + 0x00))
+#define REG_NDMA_DAD(n)     (*(vu32*)(NDMA_CHANNEL(n) + 0x04))
+#define REG_NDMA_TCNT(n)    (*(vu32*)(NDMA_CHANNEL(n) + 0x08)) // Total words
+#define REG_NDMA_WCNT(n)    (*(vu32*)(NDMA_CHANNEL(n) + 0x0C)) // Words per block
+#define REG_NDMA_BCNT(n)    (*(vu32*)(NDMA_CHANNEL(n) + 0x10))
+#define REG_NDMA_FDATA(n)   (*(vu32*)(NDMA_CHANNEL(n) + 0x14))
+#define REG_NDMA_CNT(n)     (*(vu32*)(NDMA_CHANNEL(n) + 0x18))
+
+#define NDMA_GLOBAL_ENABLE      (1u<<0)
+
+#define NDMA_DST_INCREMENT      (0u<<10)
+#define NDMA_DST_FIXED          (2u<<10)
+#define NDMA_SRC_INCREMENT      (0u<<13)
+#define NDMA_SRC_FIXED          (2u<<13)
+#define NDMA_BURST_WORDS(log2)  (((log2)&0xFu)<<16)
+#define NDMA_STARTUP(n)         (((n)&0xFu)<<24)
+#define NDMA_IMMEDIATE          (1u<<28)
+#define NDMA_REPEAT             (1u<<29)
+#define NDMA_IRQ_ENABLE         (1u<<30)
+#define NDMA_ENABLE             (1u<<31)
+
+// Startup modes
+#define NDMA_STARTUP_AES_IN     8u  // AES write FIFO has room
+#define NDMA_STARTUP_AES_OUT    9u  // AES read FIFO has data
+
+// Channels, each user owns its own
+#define NDMA_CHANNEL_AES_IN     0u
+#define NDMA_CHANNEL_AES_OUT    1u
+
+static inline void ndma_init(void) {
+    REG_NDMA_GLOBAL_CNT = NDMA_GLOBAL_ENABLE;
+}
+
+static inline void ndma_stop(u32 channel) {
+    REG_NDMA_CNT(channel) = 0;
+}
+
+static inline bool ndma_busy(u32 channel) {
+    return REG_NDMA_CNT(channel) & NDMA_ENABLE;
+}
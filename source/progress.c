@@ -0,0 +1,113 @@
+#include "progress.h"
+#include "draw.h"
+#include "timer.h"
+
+#define PROGRESS_WIDTH 50
+
+static struct {
+    size_t y;
+    u64 total;
+    u64 start_position;
+    u64 start_time;
+    u64 last_position;
+    u64 last_time;
+    u32 last_draw;
+    u32 current; // Tenths of a MB/s
+    char shown[PROGRESS_WIDTH];
+} progress;
+
+// Right aligned in width characters, padded with spaces
+static char* put_uint(char* out, u32 value, u32 width) {
+    for (u32 i = width; i-- > 0;) {
+        out[i] = (value != 0 || i == width - 1) ? '0' + value % 10 : ' ';
+        value /= 10;
+    }
+    return out + width;
+}
+
+static char* put_text(char* out, const char* text) {
+    while (*text)
+        *out++ = *text++;
+    return out;
+}
+
+// Tenths of a MB/s
+static u32 rate(u64 bytes, u64 ticks) {
+    const u64 us = TIMER_TICKS_TO_US(ticks);
+    return us == 0 ? 0 : (u32)(bytes * 10 * 1000000 / us >> 20);
+}
+
+static char* put_rate(char* out, u32 tenths) {
+    out = put_uint(out, tenths / 10, 3);
+    *out++ = '.';
+    out = put_uint(out, tenths % 10, 1);
+    return put_text(out, " MB/s");
+}
+
+static void draw(u64 position, u64 now) {
+    char line[PROGRESS_WIDTH];
+    char* p = line;
+
+    memset(line, ' ', sizeof(line));
+    const u32 percent = progress.total == 0 ? 100 : (u32)(position * 100 / progress.total);
+    // Too short an interval gives a meaningless rate, the final draw keeps
+    // the last one. A chunk that is read again moves the position back.
+    if (now - progress.last_time >= TIMER_TICKS_MS(PROGRESS_INTERVAL_MS) / 2) {
+        progress.current = position < progress.last_position ? 0 :
+            rate(position - progress.last_position, now - progress.last_time);
+        progress.last_position = position;
+        progress.last_time = now;
+    }
+    const u32 average = rate(position - progress.start_position, now - progress.start_time);
+
+    p = put_uint(p, percent, 3);
+    p = put_text(p, "%  ");
+    p = put_rate(p, progress.current);
+    p = put_text(p, "  avg ");
+    p = put_rate(p, average);
+    p = put_text(p, "  ETA ");
+    if (average > 0 && position < progress.total) {
+        const u32 seconds = (u32)((progress.total - position) * 10 / ((u64)average << 20));
+        p = put_uint(p, seconds / 60, 3);
+        *p++ = ':';
+        *p++ = '0' + seconds % 60 / 10;
+        *p++ = '0' + seconds % 10;
+    } else {
+        p = put_text(p, "  -:--");
+    }
+
+    for (u32 i = 0; i < PROGRESS_WIDTH; ++i) {
+        if (line[i] == progress.shown[i])
+            continue;
+        DrawCharacter(TOP_SCREEN0, line[i], i * 8, progress.y, RGB(255, 0, 0), RGB(255, 255, 255));
+        if (TOP_SCREEN1 != TOP_SCREEN0)
+            DrawCharacter(TOP_SCREEN1, line[i], i * 8, progress.y, RGB(255, 0, 0), RGB(255, 255, 255));
+        progress.shown[i] = line[i];
+    }
+    progress.last_draw = timer_ticks();
+}
+
+void progress_start(u64 position, u64 total) {
+    progress.y = current_y;
+    DebugBlank();
+    // The whole line is drawn the first time
+    memset(progress.shown, 0, sizeof(progress.shown));
+
+    progress.total = total;
+    progress.start_position = position;
+    progress.start_time = timer_timestamp();
+    progress.last_position = position;
+    progress.last_time = progress.start_time;
+    progress.current = 0;
+    draw(position, progress.start_time);
+}
+
+void progress_update(u64 position) {
+    if (timer_ticks() - progress.last_draw < TIMER_TICKS_MS(PROGRESS_INTERVAL_MS))
+        return;
+    draw(position, timer_timestamp());
+}
+
+void progress_end(u64 position) {
+    draw(position, timer_timestamp());
+}
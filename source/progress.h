@@ -0,0 +1,16 @@
+#pragma once
+
+#include "common.h"
+
+// Progress line of a dump: percentage, current and average throughput and
+// time left. Updating is cheap, the line is only formatted and drawn every
+// PROGRESS_INTERVAL_MS, and then only the characters that changed.
+#define PROGRESS_INTERVAL_MS 500u
+
+// Takes the next line on the screen. Positions are bytes into the whole
+// job, total its size.
+void progress_start(u64 position, u64 total);
+void progress_update(u64 position);
+
+// Draws the final state
+void progress_end(u64 position);
@@ -0,0 +1,79 @@
+#include "rsa.h"
+#include "timer.h"
+
+// DigestInfo of SHA-256, which comes right before the hash
+static const u8 sha256_digest_info[] = {
+    0x30, 0x31, 0x30, 0x0D, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01,
+    0x65, 0x03, 0x04, 0x02, 0x01, 0x05, 0x00, 0x04, 0x20,
+};
+
+static int rsa_wait(void) {
+    struct Timeout timeout;
+
+    timeout_start(&timeout, RSA_TIMEOUT_MS);
+    while (REG_RSACNT & RSA_BUSY) {
+        if (timeout_expired(&timeout))
+            return RSA_ERR_TIMEOUT;
+    }
+    return RSA_OK;
+}
+
+int rsa_setkey(const void* modulus, u32 exponent) {
+    u32 words[RSA_2048_SIZE / 4];
+    u32 keyslot = 0;
+
+    if (rsa_wait() != RSA_OK)
+        return RSA_ERR_TIMEOUT;
+    while (keyslot < RSA_KEYSLOTS && (REG_RSASLOTCNT(keyslot) & RSA_SLOT_WRITE_PROTECT))
+        keyslot++;
+    if (keyslot == RSA_KEYSLOTS)
+        return RSA_ERR_KEY;
+
+    REG_RSASLOTCNT(keyslot) &= ~RSA_SLOT_KEY_SET;
+    REG_RSACNT = RSA_KEYSLOT(keyslot) | RSA_INPUT_BIG_ENDIAN | RSA_INPUT_NORMAL_ORDER;
+
+    // The number of exponent words written sets the key size
+    for (u32 i = 0; i < RSA_2048_SIZE / 4 - 1; ++i)
+        REG_RSAEXPFIFO = 0;
+    REG_RSAEXPFIFO = ((exponent & 0xFF) << 24) | ((exponent & 0xFF00) << 8) |
+        ((exponent >> 8) & 0xFF00) | (exponent >> 24);
+
+    memcpy(words, modulus, sizeof(words));
+    for (u32 i = 0; i < RSA_2048_SIZE / 4; ++i)
+        REG_RSAMOD[i] = words[i];
+
+    if (REG_RSASLOTSIZE(keyslot) != RSA_2048_SIZE / 4 || !(REG_RSASLOTCNT(keyslot) & RSA_SLOT_KEY_SET))
+        return RSA_ERR_KEY;
+    return RSA_OK;
+}
+
+int rsa_verify_sha256(const void* signature, const void* hash) {
+    u32 words[RSA_2048_SIZE / 4];
+    u8* message = (u8*)words;
+
+    if (rsa_wait() != RSA_OK)
+        return RSA_ERR_TIMEOUT;
+
+    memcpy(words, signature, sizeof(words));
+    for (u32 i = 0; i < RSA_2048_SIZE / 4; ++i)
+        REG_RSATXT[i] = words[i];
+    REG_RSACNT |= RSA_BUSY;
+    if (rsa_wait() != RSA_OK)
+        return RSA_ERR_TIMEOUT;
+    for (u32 i = 0; i < RSA_2048_SIZE / 4; ++i)
+        words[i] = REG_RSATXT[i];
+
+    // 00 01 FF..FF 00 DigestInfo hash
+    const u32 hash_offset = RSA_2048_SIZE - 32;
+    const u32 info_offset = hash_offset - sizeof(sha256_digest_info);
+    if (message[0] != 0x00 || message[1] != 0x01 || message[info_offset - 1] != 0x00)
+        return RSA_ERR_SIGNATURE;
+    for (u32 i = 2; i < info_offset - 1; ++i) {
+        if (message[i] != 0xFF)
+            return RSA_ERR_SIGNATURE;
+    }
+    if (memcmp(message + info_offset, sha256_digest_info, sizeof(sha256_digest_info)) ||
+        memcmp(message + hash_offset, hash, 32))
+        return RSA_ERR_SIGNATURE;
+    return RSA_OK;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "common.h"
+
+#define REG_RSACNT          (*(vu32*)0x1000B000)
+#define REG_RSASLOTCNT(n)   (*(vu32*)(0x1000B100 + (n) * 0x10))
+#define REG_RSASLOTSIZE(n)  (*(vu32*)(0x1000B104 + (n) * 0x10)) // In words
+#define REG_RSAEXPFIFO      (*(vu32*)0x1000B200)
+#define REG_RSAMOD          ((vu32*)0x1000B400)
+#define REG_RSATXT          ((vu32*)0x1000B800)
+
+#define RSA_BUSY                (1u<<0)
+#define RSA_KEYSLOT(n)          (((n)&3u)<<4)
+#define RSA_INPUT_BIG_ENDIAN    (1u<<8)
+#define RSA_INPUT_NORMAL_ORDER  (1u<<9)
+
+#define RSA_SLOT_KEY_SET        (1u<<0)
+#define RSA_SLOT_WRITE_PROTECT  (1u<<1)
+
+#define RSA_KEYSLOTS            4u
+#define RSA_2048_SIZE           0x100u
+
+// No result for this long means the engine hung
+#define RSA_TIMEOUT_MS          100u
+
+#define RSA_OK                  0
+#define RSA_ERR_KEY             -1 // All keyslots are write protected
+#define RSA_ERR_SIGNATURE       -2
+#define RSA_ERR_TIMEOUT         -3
+
+// Loads an RSA-2048 public key into the first keyslot that can be written
+// and selects it. The modulus is big endian, as stored in signatures.
+int rsa_setkey(const void* modulus, u32 exponent);
+
+// Checks a PKCS #1 v1.5 RSA-2048 SHA-256 signature of hash with the key
+// last set.
+int rsa_verify_sha256(const void* signature, const void* hash);
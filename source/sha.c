@@ -0,0 +1,71 @@
+#include "sha.h"
+#include "timer.h"
+
+static int sha_wait(u32 bits) {
+    struct Timeout timeout;
+
+    timeout_start(&timeout, SHA_TIMEOUT_MS);
+    while (REG_SHACNT & bits) {
+        if (timeout_expired(&timeout))
+            return SHA_ERR_TIMEOUT;
+    }
+    return SHA_OK;
+}
+
+int sha_init(u32 mode) {
+    if (sha_wait(SHA_BUSY) != SHA_OK)
+        return SHA_ERR_TIMEOUT;
+    REG_SHACNT = SHA_MODE(mode) | SHA_OUTPUT_BIG_ENDIAN | SHA_BUSY;
+    return SHA_OK;
+}
+
+int sha_update(const void* data, size_t size) {
+    const u8* src = data;
+    u32 word;
+
+    // The FIFO takes a block at a time
+    while (size > 0) {
+        const size_t block = size < SHA_BLOCK_SIZE ? size : SHA_BLOCK_SIZE;
+
+        if (sha_wait(SHA_BUSY) != SHA_OK)
+            return SHA_ERR_TIMEOUT;
+        if (!((u32)src & 3)) {
+            const u32* words = (const u32*)src;
+            for (size_t i = 0; i < block / 4; ++i)
+                REG_SHAINFIFO = words[i];
+        } else {
+            for (size_t i = 0; i < block / 4; ++i) {
+                memcpy(&word, src + i * 4, 4);
+                REG_SHAINFIFO = word;
+            }
+        }
+        // Bytes past the last whole word
+        for (size_t i = block & ~3u; i < block; ++i)
+            ((vu8*)&REG_SHAINFIFO)[i] = src[i];
+
+        src += block;
+        size -= block;
+    }
+    return SHA_OK;
+}
+
+int sha_get(void* hash, u32 mode) {
+    const size_t size = mode == SHA_MODE_1 ? SHA_1_HASH_SIZE :
+        mode == SHA_MODE_224 ? 28 : SHA_256_HASH_SIZE;
+    u32 words[SHA_256_HASH_SIZE / 4];
+
+    REG_SHACNT = (REG_SHACNT & ~SHA_BUSY) | SHA_FINAL_ROUND;
+    if (sha_wait(SHA_FINAL_ROUND | SHA_BUSY) != SHA_OK)
+        return SHA_ERR_TIMEOUT;
+
+    for (size_t i = 0; i < SHA_256_HASH_SIZE / 4; ++i)
+        words[i] = REG_SHAHASH[i];
+    memcpy(hash, words, size);
+    return SHA_OK;
+}
+
+int sha_quick(void* hash, const void* data, size_t size, u32 mode) {
+    if (sha_init(mode) != SHA_OK || sha_update(data, size) != SHA_OK)
+        return SHA_ERR_TIMEOUT;
+    return sha_get(hash, mode);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "common.h"
+
+#define REG_SHACNT      (*(vu32*)0x1000A000)
+#define REG_SHABLKCNT   (*(vu32*)0x1000A004)
+#define REG_SHAHASH     ((vu32*)0x1000A040) // 32
+#define REG_SHAINFIFO   (*(vu32*)0x1000A080)
+
+#define SHA_BUSY                (1u<<0) // A round is running
+#define SHA_FINAL_ROUND         (1u<<1)
+#define SHA_OUTPUT_BIG_ENDIAN   (1u<<3)
+#define SHA_MODE(n)             (((n)&3u)<<4)
+
+#define SHA_MODE_256            0u
+#define SHA_MODE_224            1u
+#define SHA_MODE_1              2u
+
+#define SHA_BLOCK_SIZE          64u
+#define SHA_256_HASH_SIZE       32u
+#define SHA_1_HASH_SIZE         20u
+
+// No progress for this long means the engine hung
+#define SHA_TIMEOUT_MS          100u
+
+#define SHA_OK                  0
+#define SHA_ERR_TIMEOUT         -3
+
+// The engine hashes one stream at a time. Data may be fed in pieces of any
+// size, word aligned ones go fastest. Return SHA_OK or SHA_ERR_TIMEOUT.
+int sha_init(u32 mode);
+int sha_update(const void* data, size_t size);
+int sha_get(void* hash, u32 mode);
+
+// Hash of a single buffer
+int sha_quick(void* hash, const void* data, size_t size, u32 mode);
@@ -0,0 +1,85 @@
+#include "sigcheck.h"
+#include "fatfs/ff.h"
+#include "rsa.h"
+#include "sha.h"
+
+#define SIG_EXPONENT            0x10001u
+
+// Where the signed part of the NCSD and NCCH headers starts, it runs to
+// the end of the 0x200 byte header
+#define HEADER_SIGNED_OFFSET    0x100u
+#define HEADER_SIGNED_SIZE      0x100u
+
+#define EXHEADER_HASHED_SIZE    0x400u
+#define ACCESSDESC_SIG_OFFSET   0x400u
+#define ACCESSDESC_KEY_OFFSET   0x500u
+#define ACCESSDESC_SIGNED_SIZE  0x300u
+
+static bool load_key(const char* path, u8* modulus) {
+    FIL fp;
+    UINT bytes_read = 0;
+
+    if (f_open(&fp, path, FA_READ) != FR_OK)
+        return false;
+    f_read(&fp, modulus, RSA_2048_SIZE, &bytes_read);
+    f_close(&fp);
+    return bytes_read == RSA_2048_SIZE;
+}
+
+static enum SigResult verify(const u8* modulus, const u8* signature, const void* data, u32 size) {
+    u8 hash[SHA_256_HASH_SIZE];
+
+    if (sha_quick(hash, data, size, SHA_MODE_256) != SHA_OK || rsa_setkey(modulus, SIG_EXPONENT) != RSA_OK)
+        return SIG_ERROR;
+    switch (rsa_verify_sha256(signature, hash)) {
+        case RSA_OK:
+            return SIG_OK;
+        case RSA_ERR_SIGNATURE:
+            return SIG_BAD;
+        default:
+            return SIG_ERROR;
+    }
+}
+
+enum SigResult sig_check_ncsd(const NCSD_HEADER* ncsd) {
+    u8 modulus[RSA_2048_SIZE];
+
+    if (!load_key(SIG_NCSD_KEY_FILE, modulus))
+        return SIG_NO_KEY;
+    return verify(modulus, ncsd->sha256, (const u8*)ncsd + HEADER_SIGNED_OFFSET, HEADER_SIGNED_SIZE);
+}
+
+enum SigResult sig_check_ncch(const NCCH_HEADER* ncch, const u8* exheader) {
+    u8 modulus[RSA_2048_SIZE];
+    u8 hash[SHA_256_HASH_SIZE];
+
+    // The header covers the exheader with a hash, the access descriptor
+    // after it with its own signature
+    if (sha_quick(hash, exheader, EXHEADER_HASHED_SIZE, SHA_MODE_256) != SHA_OK)
+        return SIG_ERROR;
+    if (memcmp(hash, ncch->extended_header_sha_256_hash, sizeof(hash)))
+        return SIG_BAD;
+
+    if (!load_key(SIG_ACCESSDESC_KEY_FILE, modulus))
+        return SIG_NO_KEY;
+    enum SigResult res = verify(modulus, exheader + ACCESSDESC_SIG_OFFSET, exheader + ACCESSDESC_KEY_OFFSET,
+                                ACCESSDESC_SIGNED_SIZE);
+    if (res != SIG_OK)
+        return res;
+
+    return verify(exheader + ACCESSDESC_KEY_OFFSET, ncch->sha256, (const u8*)ncch + HEADER_SIGNED_OFFSET,
+                  HEADER_SIGNED_SIZE);
+}
+
+const char* sig_result_name(enum SigResult result) {
+    switch (result) {
+        case SIG_OK:
+            return "good";
+        case SIG_BAD:
+            return "BAD";
+        case SIG_NO_KEY:
+            return "no key, not checked";
+        default:
+            return "couldn't check";
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "common.h"
+#include "headers.h"
+
+// Checks of the RSA signatures of the cart headers, to catch bad or fake
+// carts before dumping them. The public keys aren't built in, they are
+// loaded from these files in the root of the SD card: the NCSD header key
+// and the key access descriptors are signed with, each the 0x100 byte
+// modulus, exponent 0x10001.
+#define SIG_NCSD_KEY_FILE       "/ncsd_modulus.bin"
+#define SIG_ACCESSDESC_KEY_FILE "/accessdesc_modulus.bin"
+
+enum SigResult {
+    SIG_OK,
+    SIG_BAD,    // Doesn't match, the header was changed or misread
+    SIG_NO_KEY, // Key file missing, not checked
+    SIG_ERROR,  // The engines failed or the data couldn't be read
+};
+
+// The SD card must be mounted
+enum SigResult sig_check_ncsd(const NCSD_HEADER* ncsd);
+
+// The NCCH header is signed with a key from the access descriptor in the
+// exheader, which is checked first. exheader is the plain 0x800 bytes that
+// follow the header.
+enum SigResult sig_check_ncch(const NCCH_HEADER* ncch, const u8* exheader);
+
+const char* sig_result_name(enum SigResult result);
@@ -0,0 +1,267 @@
+#include "telemetry.h"
+#include "draw.h"
+#include "format.h"
+#include "timer.h"
+#include "fatfs/sdmmc.h"
+#include "gamecart/command_ctr.h"
+#include "gamecart/protocol_ctr.h"
+
+// 320 pixels across the bottom screen
+#define TELEMETRY_WIDTH 40
+#define TELEMETRY_ROWS 20
+
+// Latencies are kept in buckets of a quarter octave of timer ticks, which
+// is accurate to 25% at any scale. Anything from 14s up goes in the last.
+#define LATENCY_BUCKETS 92
+
+struct Stage {
+    u64 ticks;
+    u64 bytes;
+};
+
+struct Latency {
+    u32 count;
+    u32 max;
+    u32 buckets[LATENCY_BUCKETS];
+};
+
+static const char* const stage_names[] = {
+    [TELEMETRY_CART_READ] = "cart read",
+    [TELEMETRY_DECRYPT] = "decrypt",
+    [TELEMETRY_HASH] = "hash",
+    [TELEMETRY_SD_WRITE] = "SD write",
+    [TELEMETRY_VERIFY] = "verify",
+};
+
+static struct {
+    bool started;
+    u64 start;
+    u32 last_draw;
+
+    u32 media_unit;
+    u32 read_size;
+    u32 options;
+
+    struct Stage stages[TELEMETRY_STAGES];
+
+    u32 reads;
+    u32 retries;
+    u32 crc_errors;
+    u32 short_reads;
+    u32 timeouts;
+    u32 resyncs;
+    u32 backoff[CTR_READ_BACKOFF_LEVELS + 1]; // Reads made at each level
+
+    struct Latency sd_read;
+    struct Latency sd_write;
+
+    u32 buffer_used;
+    u32 buffer_size;
+    u32 ring_used;
+    u32 ring_size;
+    u32 ring_peak;
+
+    char shown[TELEMETRY_ROWS][TELEMETRY_WIDTH];
+} telemetry;
+
+void telemetry_reset(void) {
+    memset(&telemetry, 0, sizeof(telemetry));
+}
+
+void telemetry_set_mode(u32 media_unit, u32 read_size, u32 options) {
+    // Counted from the first dump, not from the prompts before it
+    if (!telemetry.started) {
+        telemetry.started = true;
+        telemetry.start = timer_timestamp();
+    }
+    telemetry.media_unit = media_unit;
+    telemetry.read_size = read_size;
+    telemetry.options = options;
+}
+
+void telemetry_stage(enum TelemetryStage stage, u32 start, u32 bytes) {
+    telemetry.stages[stage].ticks += timer_ticks() - start;
+    telemetry.stages[stage].bytes += bytes;
+}
+
+void telemetry_cart_read(int res, u32 level) {
+    telemetry.reads++;
+    if (level > 0)
+        telemetry.retries++;
+    if (level <= CTR_READ_BACKOFF_LEVELS)
+        telemetry.backoff[level]++;
+
+    switch (res) {
+        case CTRCARD_OK:
+            break;
+        case CTRCARD_ERR_CRC:
+            telemetry.crc_errors++;
+            break;
+        case CTRCARD_ERR_TIMEOUT:
+            telemetry.timeouts++;
+            break;
+        default:
+            telemetry.short_reads++;
+            break;
+    }
+}
+
+void telemetry_resync(void) {
+    telemetry.resyncs++;
+}
+
+static u32 latency_bucket(u32 ticks) {
+    if (ticks < 4)
+        return ticks;
+    // The top bit picks the octave, the two below it the quarter
+    const u32 octave = 31 - __builtin_clz(ticks);
+    const u32 bucket = (octave - 1) * 4 + ((ticks >> (octave - 2)) & 3);
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+// First tick past the bucket
+static u32 bucket_end(u32 bucket) {
+    if (bucket < 4)
+        return bucket + 1;
+    const u32 shift = bucket / 4 - 1;
+    return (5 + bucket % 4) << shift;
+}
+
+void telemetry_sd_command(bool write, u32 start) {
+    const u32 ticks = timer_ticks() - start;
+    struct Latency* latency = write ? &telemetry.sd_write : &telemetry.sd_read;
+
+    latency->count++;
+    latency->buckets[latency_bucket(ticks)]++;
+    if (ticks > latency->max)
+        latency->max = ticks;
+}
+
+void telemetry_buffer(u32 used, u32 size) {
+    telemetry.buffer_used = used;
+    telemetry.buffer_size = size;
+}
+
+void telemetry_ring(u32 used, u32 size) {
+    telemetry.ring_used = used;
+    telemetry.ring_size = size;
+    if (used > telemetry.ring_peak)
+        telemetry.ring_peak = used;
+}
+
+// In microseconds, the end of the bucket the percentile falls in
+static u32 percentile(const struct Latency* latency, u32 percent) {
+    const u64 target = (u64)latency->count * percent;
+    u64 seen = 0;
+
+    if (latency->count == 0)
+        return 0;
+    for (u32 i = 0; i < LATENCY_BUCKETS; ++i) {
+        seen += (u64)latency->buckets[i] * 100;
+        if (seen >= target) {
+            const u32 end = i == LATENCY_BUCKETS - 1 ? latency->max : bucket_end(i);
+            return (u32)TIMER_TICKS_TO_US(end < latency->max ? end : latency->max);
+        }
+    }
+    return (u32)TIMER_TICKS_TO_US(latency->max);
+}
+
+static void format_latency(char* line, const char* name, const struct Latency* latency) {
+    fmt_format(line, TELEMETRY_WIDTH + 1, "%-6s%7lu%8lu%8lu%9lu", name, (unsigned long)percentile(latency, 50),
+               (unsigned long)percentile(latency, 90), (unsigned long)percentile(latency, 99),
+               (unsigned long)TIMER_TICKS_TO_US(latency->max));
+}
+
+static void format_stage(char* line, enum TelemetryStage stage, u64 elapsed) {
+    const struct Stage* s = &telemetry.stages[stage];
+    const u64 us = TIMER_TICKS_TO_US(s->ticks);
+    // Tenths of a MB/s
+    const u32 rate = us == 0 ? 0 : (u32)(s->bytes * 10 * 1000000 / us >> 20);
+    const u32 busy = elapsed == 0 ? 0 : (u32)(s->ticks * 100 / elapsed);
+
+    fmt_format(line, TELEMETRY_WIDTH + 1, "%-10s%5lu.%lu%9lu%6lu%%", stage_names[stage],
+               (unsigned long)(rate / 10), (unsigned long)(rate % 10), (unsigned long)(s->bytes >> 20),
+               (unsigned long)busy);
+}
+
+static void format_sd_mode(char* line) {
+    const mmcdevice* sd = getMMCDevice(1);
+    // The card clock is the bus clock over 4 times the divider bits, or
+    // over 2 without any
+    const u32 divider = (sd->clk & 0xFF) ? (sd->clk & 0xFF) * 4 : 2;
+    const u32 khz = TIMER_BASE_FREQ / divider / 1000;
+
+    fmt_format(line, TELEMETRY_WIDTH + 1, "SD    %s  %s bus  %lu.%lu MHz", sd->isSDHC ? "SDHC" : "SDSC",
+               sd->SDOPT ? "4-bit" : "1-bit", (unsigned long)(khz / 1000), (unsigned long)(khz % 1000 / 100));
+}
+
+static void format_lines(char lines[TELEMETRY_ROWS][TELEMETRY_WIDTH + 1]) {
+    const u64 elapsed = telemetry.started ? timer_timestamp() - telemetry.start : 0;
+    const u32 seconds = (u32)(TIMER_TICKS_TO_US(elapsed) / 1000000);
+    const u32 options = telemetry.options;
+    const u32 buffer = telemetry.buffer_size == 0 ? 0 :
+        (u32)((u64)telemetry.buffer_used * 100 / telemetry.buffer_size);
+    u32 row = 0;
+
+    fmt_format(lines[row++], TELEMETRY_WIDTH + 1, "Telemetry %27lu:%02lu", (unsigned long)(seconds / 60),
+               (unsigned long)(seconds % 60));
+    fmt_format(lines[row++], TELEMETRY_WIDTH + 1, "Cart  CTR  unit %lu  reads %luK",
+               (unsigned long)telemetry.media_unit,
+               (unsigned long)(telemetry.read_size * telemetry.media_unit >> 10));
+    fmt_format(lines[row++], TELEMETRY_WIDTH + 1, "Mode %s%s%s%s%s", options ? "" : " plain",
+               (options & TELEMETRY_DUAL_READ) ? " dual-read" : "",
+               (options & TELEMETRY_VERIFY_WRITES) ? " verify" : "",
+               (options & TELEMETRY_DECRYPTED) ? " decrypt" : "",
+               (options & TELEMETRY_HASHED) ? " hash" : "");
+    format_sd_mode(lines[row++]);
+    lines[row++][0] = '\0';
+
+    fmt_format(lines[row++], TELEMETRY_WIDTH + 1, "%-10s%7s%9s%7s", "Stage", "MB/s", "MB", "busy");
+    for (u32 stage = 0; stage < TELEMETRY_STAGES; ++stage)
+        format_stage(lines[row++], stage, elapsed);
+    fmt_format(lines[row++], TELEMETRY_WIDTH + 1, "Buffer %3lu%%  verify ring %2lu/%lu peak %lu",
+               (unsigned long)buffer, (unsigned long)telemetry.ring_used, (unsigned long)telemetry.ring_size,
+               (unsigned long)telemetry.ring_peak);
+    lines[row++][0] = '\0';
+
+    fmt_format(lines[row++], TELEMETRY_WIDTH + 1, "Reads %7lu  retries %5lu  resync %3lu",
+               (unsigned long)telemetry.reads, (unsigned long)telemetry.retries, (unsigned long)telemetry.resyncs);
+    fmt_format(lines[row++], TELEMETRY_WIDTH + 1, "CRC %5lu  short %5lu  timeout %5lu",
+               (unsigned long)telemetry.crc_errors, (unsigned long)telemetry.short_reads,
+               (unsigned long)telemetry.timeouts);
+    fmt_format(lines[row++], TELEMETRY_WIDTH + 1, "Backoff 1-4 %6lu%6lu%6lu%6lu", (unsigned long)telemetry.backoff[1],
+               (unsigned long)telemetry.backoff[2], (unsigned long)telemetry.backoff[3],
+               (unsigned long)telemetry.backoff[4]);
+    lines[row++][0] = '\0';
+
+    fmt_format(lines[row++], TELEMETRY_WIDTH + 1, "%-6s%7s%8s%8s%9s", "SD us", "p50", "p90", "p99", "max");
+    format_latency(lines[row++], "write", &telemetry.sd_write);
+    format_latency(lines[row++], "read", &telemetry.sd_read);
+}
+
+void telemetry_draw(void) {
+    char lines[TELEMETRY_ROWS][TELEMETRY_WIDTH + 1];
+
+    format_lines(lines);
+    for (u32 y = 0; y < TELEMETRY_ROWS; ++y) {
+        bool ended = false;
+        for (u32 x = 0; x < TELEMETRY_WIDTH; ++x) {
+            // Short lines are padded out, so what was there before goes
+            ended = ended || lines[y][x] == '\0';
+            const char c = ended ? ' ' : lines[y][x];
+            if (c == telemetry.shown[y][x])
+                continue;
+            DrawCharacter(BOT_SCREEN0, c, x * 8, y * 10, RGB(255, 0, 0), RGB(255, 255, 255));
+            if (BOT_SCREEN1 != BOT_SCREEN0)
+                DrawCharacter(BOT_SCREEN1, c, x * 8, y * 10, RGB(255, 0, 0), RGB(255, 255, 255));
+            telemetry.shown[y][x] = c;
+        }
+    }
+    telemetry.last_draw = timer_ticks();
+}
+
+void telemetry_update(void) {
+    if (timer_ticks() - telemetry.last_draw < TIMER_TICKS_MS(TELEMETRY_INTERVAL_MS))
+        return;
+    telemetry_draw();
+}
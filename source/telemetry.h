@@ -0,0 +1,48 @@
+#pragma once
+
+#include "common.h"
+
+// Dump statistics on the bottom screen, to see where a slow unit loses
+// its time. Recording is a few adds on timer ticks, the screen is only
+// redrawn every TELEMETRY_INTERVAL_MS, and then only what changed.
+#define TELEMETRY_INTERVAL_MS 1000u
+
+enum TelemetryStage {
+    TELEMETRY_CART_READ,
+    TELEMETRY_DECRYPT,
+    TELEMETRY_HASH,
+    TELEMETRY_SD_WRITE,
+    TELEMETRY_VERIFY,
+
+    TELEMETRY_STAGES
+};
+
+// Dump options shown with the cart mode
+#define TELEMETRY_DUAL_READ (1u << 0)
+#define TELEMETRY_VERIFY_WRITES (1u << 1)
+#define TELEMETRY_DECRYPTED (1u << 2)
+#define TELEMETRY_HASHED (1u << 3)
+
+// Clears the counters, for the next cart
+void telemetry_reset(void);
+void telemetry_set_mode(u32 media_unit, u32 read_size, u32 options);
+
+// start is timer_ticks() from before the stage ran
+void telemetry_stage(enum TelemetryStage stage, u32 start, u32 bytes);
+
+// One read command to the cart, at the given backoff level
+void telemetry_cart_read(int res, u32 level);
+void telemetry_resync(void);
+
+// One SD card command, start is timer_ticks() from before it was sent
+void telemetry_sd_command(bool write, u32 start);
+
+// How much of the dump buffer holds data, and how many ranges are queued
+// in the verify ring
+void telemetry_buffer(u32 used, u32 size);
+void telemetry_ring(u32 used, u32 size);
+
+// Redraws if TELEMETRY_INTERVAL_MS have passed since the last time
+void telemetry_update(void);
+// Redraws now
+void telemetry_draw(void);
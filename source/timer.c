@@ -0,0 +1,36 @@
+#include "timer.h"
+
+void timer_init(void) {
+    for (int i = 0; i < 3; ++i) {
+        REG_TIMER_CNT(i) = 0;
+        REG_TIMER_VAL(i) = 0;
+    }
+
+    // Start the high parts first, so they're already counting when the
+    // lower ones overflow for the first time
+    REG_TIMER_CNT(2) = TIMER_START | TIMER_CASCADE;
+    REG_TIMER_CNT(1) = TIMER_START | TIMER_CASCADE;
+    REG_TIMER_CNT(0) = TIMER_START | TIMER_DIV_64;
+}
+
+u64 timer_timestamp(void) {
+    u16 top, top2;
+    u32 ticks;
+
+    // Retry if the low 32 bits wrapped while reading
+    do {
+        top = REG_TIMER_VAL(2);
+        ticks = timer_ticks();
+        top2 = REG_TIMER_VAL(2);
+    } while (top != top2);
+
+    return ((u64)top << 32) | ticks;
+}
+
+void timer_delay_us(u32 us) {
+    // +1 because the first tick may be almost over already
+    const u32 ticks = (u32)TIMER_US_TO_TICKS(us) + 1;
+    const u32 start = timer_ticks();
+
+    while (timer_ticks() - start < ticks);
+}
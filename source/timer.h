@@ -0,0 +1,73 @@
+#pragma once
+
+#include "common.h"
+
+#define REG_TIMER_VAL(n) (*(vu16*)(0x10003000 + 4 * (n)))
+#define REG_TIMER_CNT(n) (*(vu16*)(0x10003002 + 4 * (n)))
+
+#define TIMER_DIV_1     0u
+#define TIMER_DIV_64    1u
+#define TIMER_DIV_256   2u
+#define TIMER_DIV_1024  3u
+#define TIMER_CASCADE   (1u << 2)
+#define TIMER_START     (1u << 7)
+
+// Timers 0 to 2 are chained into a free running 48-bit counter at the
+// ARM9 bus clock / 64, about 1.05MHz. The low 32 bits wrap after a bit
+// more than an hour, differences between two readings stay correct across
+// that. The whole counter doesn't wrap for years.
+#define TIMER_BASE_FREQ 67027964u
+#define TIMER_PRESCALER 64u
+#define TIMER_FREQ      (TIMER_BASE_FREQ / TIMER_PRESCALER)
+#define TIMER_TICKS_MS(ms) ((u32)(ms) * (TIMER_FREQ / 1000))
+
+// Exact conversions, rounded up when going to ticks so delays are never
+// shorter than asked for
+#define TIMER_TICKS_TO_US(ticks) ((u64)(ticks) * TIMER_PRESCALER * 1000000u / TIMER_BASE_FREQ)
+#define TIMER_US_TO_TICKS(us) \
+    (((u64)(us) * TIMER_BASE_FREQ + TIMER_PRESCALER * 1000000u - 1) / (TIMER_PRESCALER * 1000000u))
+
+void timer_init(void);
+
+static inline u32 timer_ticks(void) {
+    u16 high = REG_TIMER_VAL(1);
+    u16 low = REG_TIMER_VAL(0);
+    u16 high2 = REG_TIMER_VAL(1);
+
+    // The low half wrapped between the reads
+    if (high != high2)
+        low = REG_TIMER_VAL(0);
+    return ((u32)high2 << 16) | low;
+}
+
+// Ticks since timer_init(), for timestamps that have to outlive the wrap
+// of timer_ticks().
+u64 timer_timestamp(void);
+
+static inline u64 timer_elapsed_us(u64 since) {
+    return TIMER_TICKS_TO_US(timer_timestamp() - since);
+}
+
+// Busy waits for at least the given time. One tick is a bit less than a
+// microsecond, so the delay is at most a microsecond longer than asked.
+void timer_delay_us(u32 us);
+
+static inline void timer_delay_ms(u32 ms) {
+    timer_delay_us(ms * 1000);
+}
+
+// Deadline for hardware polling loops. Checking it is a few register reads,
+// so it can be done on every iteration of a wait.
+struct Timeout {
+    u32 start;
+    u32 length;
+};
+
+static inline void timeout_start(struct Timeout* timeout, u32 ms) {
+    timeout->start = timer_ticks();
+    timeout->length = TIMER_TICKS_MS(ms);
+}
+
+static inline bool timeout_expired(const struct Timeout* timeout) {
+    return timer_ticks() - timeout->start >= timeout->length;
+}